@@ -8,27 +8,31 @@ function check_error {
 }
 
 echo "test01: Animated Transformations"
-./view -i -t 2.5 scenes/test01.json
+./view -i "$@" -t 2.5 scenes/test01.json
 check_error
 
 echo "test02: Skinned Mesh"
-./view -i -t 2.5 scenes/test02.json
+./view -i "$@" -t 2.5 scenes/test02.json
 check_error
 
 echo "test03: Particles"
-./view -i -t 2.5 scenes/test03.json
+./view -i "$@" -t 2.5 scenes/test03.json
 check_error
 
 echo "test04: Cloth"
-./view -i -t 10 scenes/test04.json
+./view -i "$@" -t 10 scenes/test04.json
 check_error
 
 echo "test05: Rain (Beware, this chugs)"
-./view -i -t 10 scenes/test05.json
+./view -i "$@" -t 10 scenes/test05.json
 check_error
 
 echo "test06: Snow"
-./view -i -t 10 scenes/test06.json
+./view -i "$@" -t 10 scenes/test06.json
+check_error
+
+echo "test07: Colliders"
+./view -i "$@" -t 5 scenes/test07.json
 check_error
 
 echo "All completed successfully!"
@@ -8,6 +8,9 @@
 #include "igl/draw.h"
 #include "igl/intersect.h"
 #include "igl/tesselate.h"
+#include "igl/shade.h"
+#include "igl/simcache.h"
+#include "common/parallel.h"
 
 #define AUTORELOAD
 
@@ -15,6 +18,11 @@
 #include <sys/stat.h>
 #endif
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
 ///@file apps/view.cpp View: Interactice Viewer @ingroup apps
 ///@defgroup view View: Interactice Viewer
 ///@ingroup apps
@@ -23,10 +31,17 @@
 const bool          fixed_dt = true; ///< fixed frame time
 
 bool                screenshotAndExit = false; ///< take a screenshot and exit right away
+bool                headless = false; ///< render on the cpu without opening a window, save the image and exit
+
+int                 batch_frame_first = 0; ///< first frame rendered in batch mode
+int                 batch_frame_last = -1; ///< last frame rendered in batch mode (less than first for no batch)
+float               batch_fps = 30; ///< batch mode frames per second
+int                 batch_writers = 2; ///< batch mode image writer threads
 
 Scene*              scene = nullptr; ///< scene
 
 DrawOptions         draw_opts; ///< draw options
+DrawStats           draw_stats; ///< primitive counts of the last draw (shown in the hud)
 
 float               time_init_advance = 0.0f; ///< how much to initially advance time
 bool                animating = false; ///< whether it is currently playing back animation
@@ -34,12 +49,18 @@ bool                animating_steps = false;
 range1f             animate_interval = range1f(); ///< scene animation interval
 bool                animate_loop = false; ///< whether to loop the animation
 bool                simulate_has = false; ///< whether the scene has simulation
+SimulationCache     simulate_cache; ///< simulation snapshots and baked frames (to seek without simulating from the start)
+
+string              filename_bake = ""; ///< baked simulation filename to write (empty for none)
+int                 bake_frames = 300; ///< number of frames to bake
+string              filename_baked = ""; ///< baked simulation filename to play back (empty for none)
 
 string              filename_scene = ""; ///< scene filename
 string              filename_image = ""; ///< captured image filename
 
 int                 tesselation_level = -1; ///< tesselation override level (-1 for default)
 bool                tesselation_smooth = false; ///< tesselation override smooth
+float               tesselation_lod_toggled = 4; ///< level of detail edge pixels swapped with the draw option one by the lod toggle (off by default)
 
 bool                hud = true; ///< whether to display the hud
 timer_avg           hud_fps_update; ///< whether to display update frames-per-second in the hud
@@ -71,7 +92,7 @@ void animate_update() {
     else dt = clamp(dt,0.0f,animate_interval.max-draw_opts.time);
     if(dt > 0) {
         draw_opts.time += dt;
-        scene_simulation_update(scene,dt);
+        if(simulate_has) simcache_update(&simulate_cache,scene,dt);
         update_timer.start();
     } else {
         if(draw_opts.time >= animate_interval.max) animate_stop();
@@ -90,7 +111,7 @@ void animate_step(bool forward) {
     else dt = clamp(-1/30.0f,animate_interval.min-draw_opts.time,0.0f);
     if(dt != 0) {
         draw_opts.time += dt;
-        if(simulate_has) scene_simulation_update(scene,dt);
+        if(simulate_has) simcache_update(&simulate_cache,scene,dt);
     }
 }
 
@@ -136,9 +157,12 @@ void selection_subelement_next(bool forward) {
 void selection_move(const vec3f& t) {
     if(selected_point) {
         *selected_point += transform_vector(*selected_frame,t);
+        shape_changed(cast<Surface>(scene->prims->prims[selected_element])->shape);
         shape_tesselation_init(cast<Surface>(scene->prims->prims[selected_element])->shape, tesselation_level >= 0, tesselation_level, tesselation_smooth);
+        shape_bvh_refit(cast<Surface>(scene->prims->prims[selected_element])->shape);
     }
     else if(selected_frame) selected_frame->o += transform_vector(*selected_frame,t);
+    scene_bvh_refit(scene);
 }
 
 /// rotate selection
@@ -151,18 +175,20 @@ void selection_rotate(const vec3f& ea) {
                  rotation_matrix(ea.z, selected_frame->z) *
                  translation_matrix(- selected_frame->o);
         *selected_frame = transform_frame(m, *selected_frame);
+        scene_bvh_refit(scene);
     }
 }
 
 /// init scene
 void init() {
     scene_tesselation_init(scene,tesselation_level>=0,tesselation_level,tesselation_smooth);
+    scene_bvh_clear(scene);
     scene_defaultgizmos_init(scene);
     animate_interval = scene_animation_interval(scene);
     simulate_has = scene_simulation_has(scene);
     if(simulate_has) {
         animate_interval.max = 1e10f;
-        scene_simulation_init(scene);
+        simcache_init(&simulate_cache,scene);
     }
     //draw_opts.time = 0;
     selection_element_clear();
@@ -181,6 +207,105 @@ void screenshot(const char *filename_png) {
     imageio_write_png(filename_png, img, true);
 }
 
+/// advance time by fixed steps as during playback, then render on the cpu and save the image
+void headless_render() {
+    while(draw_opts.time < time_init_advance) {
+        auto time = draw_opts.time;
+        animate_step(true);
+        if(draw_opts.time == time) break;
+    }
+    image3f img = shade_scene(scene, draw_opts);
+    imageio_write_auto(filename_image, img, true);
+}
+
+/// images waiting to be saved by writer threads, so that encoding a frame overlaps rendering the next ones
+struct ImageWriteQueue {
+    /// Constructor (starts nthreads writers; push blocks while capacity images are waiting)
+    ImageWriteQueue(int nthreads, int capacity) : _capacity(capacity) {
+        for(int t = 0; t < nthreads; t ++) _threads.push_back(std::thread([this](){ _write(); }));
+    }
+    
+    /// queue an image to be saved
+    void push(const string& filename, image3f&& img) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _not_full.wait(lock, [this](){ return _images.size() < _capacity; });
+        _images.push_back(pair<string,image3f>(filename, std::move(img)));
+        _not_empty.notify_one();
+    }
+    
+    /// save the remaining images and stop the writers
+    void finish() {
+        { std::unique_lock<std::mutex> lock(_mutex); _done = true; }
+        _not_empty.notify_all();
+        for(auto& thread : _threads) thread.join();
+        _threads.clear();
+    }
+    
+private:
+    void _write() {
+        while(true) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _not_empty.wait(lock, [this](){ return _done or not _images.empty(); });
+            if(_images.empty()) return;
+            auto image = std::move(_images.front());
+            _images.pop_front();
+            _not_full.notify_one();
+            lock.unlock();
+            imageio_write_auto(image.first, image.second, true);
+        }
+    }
+    
+    size_t _capacity;
+    bool _done = false;
+    std::deque<pair<string,image3f>> _images;
+    vector<std::thread> _threads;
+    std::mutex _mutex;
+    std::condition_variable _not_empty, _not_full;
+};
+
+/// expand the frame number in a batch image filename pattern, which must have exactly one %d conversion, optionally
+/// with a width (like %04d), and may have %% for a literal %; the pattern is never used as a printf format,
+/// since it comes from the command line; returns false if the pattern is not valid
+bool batch_image_filename(const string& pattern, int frame, string& filename) {
+    filename.clear();
+    int conversions = 0;
+    for(int i = 0; i < pattern.size(); i ++) {
+        if(pattern[i] != '%') { filename += pattern[i]; continue; }
+        if(i+1 < pattern.size() and pattern[i+1] == '%') { filename += '%'; i ++; continue; }
+        auto end = i+1;
+        while(end < pattern.size() and isdigit(pattern[end])) end ++;
+        if(end >= pattern.size() or pattern[end] != 'd' or end-i-1 > 2 or conversions ++) return false;
+        auto width = (end > i+1) ? atoi(pattern.substr(i+1,end-i-1).c_str()) : 0;
+        auto pad = (pattern[i+1] == '0') ? '0' : ' ';
+        auto digits = std::to_string(abs(frame));
+        auto sign = string((frame < 0) ? "-" : "");
+        auto fill = string(max(0, width - (int)(sign.size() + digits.size())), pad);
+        filename += (pad == '0') ? sign + fill + digits : fill + sign + digits;
+        i = end;
+    }
+    return conversions == 1;
+}
+
+/// render frames batch_frame_first to batch_frame_last on the cpu, saving one image per frame;
+/// time always starts from zero and frame k is at k / batch_fps, so the same range always gives the same images
+void batch_render() {
+    auto filename = string();
+    error_if_not(batch_image_filename(filename_image, 0, filename), "batch image filename needs exactly one frame number pattern, like out_%04d.png");
+    ImageWriteQueue writer(batch_writers, 2*batch_writers);
+    for(int frame = 0; frame <= batch_frame_last; frame ++) {
+        auto time = frame / batch_fps;
+        if(frame > 0) {
+            auto dt = time - draw_opts.time;
+            draw_opts.time = time;
+            if(simulate_has) simcache_update(&simulate_cache,scene,dt);
+        }
+        if(frame < batch_frame_first) continue;
+        batch_image_filename(filename_image, frame, filename);
+        writer.push(filename, shade_scene(scene, draw_opts));
+    }
+    writer.finish();
+}
+
 #ifdef AUTORELOAD
 bool reload_auto = false;
 #endif
@@ -227,7 +352,9 @@ void print_help() {
            "8                   scene tesselation descrease\n"
            "9                   scene tesselation increase\n"
            "0                   scene tesselation smooth\n"
+           "l                   tesselation level of detail on/off\n"
            "`                   doublesided on/off\n"
+           "6                   frustum culling on/off\n"
            "f                   frame\n"
            "\n"
            "application ------------------------\n"
@@ -240,7 +367,7 @@ void print_help() {
            "\n"
            "animation --------------------------\n"
            "space               animation on/off\n"
-           ",/.                 animation step\n"
+           ",/.                 animation step (back restores simulation snapshots)\n"
            "\n"
            "editing ----------------------------\n"
            "[/]                 select primitive/light\n"
@@ -266,10 +393,12 @@ void keyboard(unsigned char c, int x, int y) {
         case '4': draw_opts.control = not draw_opts.control; break;
         case '$': draw_opts.control_no_depth = not draw_opts.control_no_depth; break;
         case '5': draw_opts.gizmos = not draw_opts.gizmos; break;
+        case '6': draw_opts.cull = not draw_opts.cull; break;
         case '7': draw_opts.cameralights = not draw_opts.cameralights; break;
         case '8': tesselation_level = max(-1,tesselation_level-1); init(); break;
         case '9': tesselation_level = min(88,tesselation_level+1); init(); break;
         case '0': tesselation_smooth = !tesselation_smooth; init(); break;
+        case 'l': swap(draw_opts.lod_pixels, tesselation_lod_toggled); break;
         case '`': draw_opts.doublesided = not draw_opts.doublesided; break;
         case ' ': if(animating) animate_stop(); else animate_start(); break;
         case '/': init(); break;
@@ -392,13 +521,26 @@ void draw_string(const string& name) {
 /// draw hud
 void display_hud() {
     char buf[2048];
-    sprintf(buf, "time: %6d / draw: %s%s%s%s%s / light: %s / tess: %2d%s",
+    sprintf(buf, "time: %6d / draw: %s%s%s%s%s / light: %s / tess: %2d%s%s",
             (int)round(draw_opts.time*1000),
             (draw_opts.faces)?"f":" ",(draw_opts.edges)?"e":" ",
             (draw_opts.lines)?"l":" ",(draw_opts.control)?"c":" ",
             (draw_opts.doublesided)?"d":" ",
             (draw_opts.cameralights)?"c":"s",
-            tesselation_level,(tesselation_smooth)?"s":"f");
+            tesselation_level,(tesselation_smooth)?"s":"f",(draw_opts.lod_pixels > 0)?"l":" ");
+    sprintf(buf+strlen(buf), " / prims: %d drawn, %d culled, %d small",
+            draw_stats.drawn, draw_stats.culled_frustum, draw_stats.culled_small);
+    if(simulate_has) {
+        // simulation steps of the last update, summed over the simulated surfaces
+        auto steps = 0, steps_fixed = 0;
+        for(auto prim : scene->prims->prims) {
+            if(not is<SimulatedSurface>(prim)) continue;
+            auto simulator = cast<SimulatedSurface>(prim)->_simulator;
+            steps += simulator->stats.update_steps;
+            steps_fixed += (simulator->stats.updates) ? simulator->stats.steps_fixed / simulator->stats.updates : 0;
+        }
+        sprintf(buf+strlen(buf), " / steps: %4d/%4d", steps, steps_fixed);
+    }
 //    msg01 += "/"+to_string("%3d",(int)round(1/hud_fps_display.elapsed()));
 //    msg01 += "/"+to_string("%3d",(animating)?(int)round(1/hud_fps_update.elapsed()):0);
     
@@ -422,7 +564,7 @@ void display_hud() {
 void display() {
     hud_fps_display.start();
     if(draw_opts.cameralights) scene_cameralights_update(scene,draw_opts.cameralights_dir,draw_opts.cameralights_col);
-    draw_scene(scene,draw_opts,true);
+    draw_scene(scene,draw_opts,true,&draw_stats);
     draw_scene_decorations(scene,draw_opts,false);
     glFlush();
     hud_fps_display.stop();
@@ -510,7 +652,15 @@ void parse_args(int argc, char** argv) {
         
         TCLAP::SwitchArg hudArg("j","hud","HUD",cmd);
         TCLAP::SwitchArg screenshotAndExitArg("i","screenshotAndExit","Screenshot and exit",cmd);
+        TCLAP::SwitchArg headlessArg("H","headless","Render on the cpu without a window, save and exit",cmd);
         TCLAP::ValueArg<float> timeArg("t","time","Time advance (delays screenshot and exit)",false,0,"seconds",cmd);
+        TCLAP::ValueArg<string> framesArg("F","frames","Render frames on the cpu without a window, one image each (named by a pattern like out_%04d.png)",false,"","first:last",cmd);
+        TCLAP::ValueArg<float> fpsArg("","fps","Frames per second for rendering and baking frames",false,30,"fps",cmd);
+        TCLAP::ValueArg<float> snapshotsArg("","snapshots","Simulation time between snapshots used to seek (0 for none)",false,1,"seconds",cmd);
+        TCLAP::ValueArg<string> bakeArg("","bake","Simulate and save the simulated shapes of each frame to a baked file, then exit",false,"","filename",cmd);
+        TCLAP::ValueArg<int> bakeFramesArg("","bake-frames","Number of frames to bake",false,300,"frames",cmd);
+        TCLAP::ValueArg<string> bakedArg("","baked","Play back the simulation from a baked file",false,"","filename",cmd);
+        TCLAP::ValueArg<int> threadsArg("","threads","Threads for simulation and cpu rendering (0 for one per core)",false,0,"threads",cmd);
         
         TCLAP::UnlabeledValueArg<string> filenameScene("scene","Scene filename",true,"","scene",cmd);
         TCLAP::UnlabeledValueArg<string> filenameImage("image","Image filename",false,"","image",cmd);
@@ -521,10 +671,22 @@ void parse_args(int argc, char** argv) {
         if(samplesArg.isSet()) draw_opts.samples = samplesArg.getValue();
         if(hudArg.isSet()) hud = not hudArg.getValue();
         if(screenshotAndExitArg.isSet()) screenshotAndExit = screenshotAndExitArg.getValue();
+        if(headlessArg.isSet()) headless = headlessArg.getValue();
         if(timeArg.isSet()) time_init_advance = timeArg.getValue();
+        if(framesArg.isSet()) {
+            auto parsed = sscanf(framesArg.getValue().c_str(), "%d:%d", &batch_frame_first, &batch_frame_last);
+            error_if_not(parsed == 2 and batch_frame_first >= 0 and batch_frame_last >= batch_frame_first, "frames should be first:last");
+        }
+        if(fpsArg.isSet()) batch_fps = fpsArg.getValue();
+        if(snapshotsArg.isSet()) simulate_cache.snapshot_interval = snapshotsArg.getValue();
+        if(bakeArg.isSet()) filename_bake = bakeArg.getValue();
+        if(bakeFramesArg.isSet()) bake_frames = bakeFramesArg.getValue();
+        if(bakedArg.isSet()) filename_baked = bakedArg.getValue();
+        if(threadsArg.isSet()) parallel_set_nthreads(threadsArg.getValue());
         
         filename_scene = filenameScene.getValue();
         if(filenameImage.isSet()) filename_image = filenameImage.getValue();
+        else if(batch_frame_last >= batch_frame_first) { filename_image = filename_scene.substr(0,filename_scene.length()-5)+"_%04d.png"; }
         else { filename_image = filename_scene.substr(0,filename_scene.length()-4)+"png"; }
 	} catch (TCLAP::ArgException &e) { 
         std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl; 
@@ -534,7 +696,11 @@ void parse_args(int argc, char** argv) {
 /// main: parses args, loads scene, start gui
 int main(int argc, char** argv) {
     parse_args(argc, argv);
+    if(not filename_baked.empty()) simulate_cache._bake = simcache_bake_open(filename_baked);
     load();
+    if(not filename_bake.empty()) { simcache_bake(scene, filename_bake, batch_fps, bake_frames); return 0; }
+    if(batch_frame_last >= batch_frame_first) { batch_render(); return 0; }
+    if(headless) { headless_render(); return 0; }
 	init(&argc, argv);
 
     if( time_init_advance > 0.0f ) {
@@ -0,0 +1,207 @@
+#include "parallel.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <cstdio>
+
+///@file common/parallel.cpp Parallel loops. @ingroup common
+
+/// range of a parallel loop waiting to run
+struct _ParallelTask {
+    const function<void (int,int)>*     body = nullptr; ///< loop body
+    int                                 start = 0; ///< range start
+    int                                 end = 0; ///< range end
+    std::atomic<int>*                   pending = nullptr; ///< ranges of the loop not done yet
+};
+
+/// tasks queued by a thread: the owner pushes and pops at the back (the last tasks pushed, for locality),
+/// while other threads steal from the front (the oldest)
+struct _ParallelDeque {
+    std::mutex                          mutex; ///< protects the tasks
+    _ParallelTask                       tasks[parallel_deque_capacity]; ///< ring buffer
+    int                                 front = 0; ///< first task (in the ring buffer)
+    int                                 count = 0; ///< number of tasks
+
+    /// add a task at the back; returns false if full
+    bool push(const _ParallelTask& task) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(count == parallel_deque_capacity) return false;
+        tasks[(front + count++) % parallel_deque_capacity] = task;
+        return true;
+    }
+
+    /// remove the task at the back; returns false if empty
+    bool pop(_ParallelTask& task) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(not count) return false;
+        task = tasks[(front + --count) % parallel_deque_capacity];
+        return true;
+    }
+
+    /// remove the task at the front; returns false if empty
+    bool steal(_ParallelTask& task) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(not count) return false;
+        task = tasks[front];
+        front = (front + 1) % parallel_deque_capacity;
+        count --;
+        return true;
+    }
+};
+
+/// pool of worker threads, each with its own task queue; threads outside the pool share one more queue
+struct _ParallelPool {
+    vector<std::thread>                 threads; ///< workers (the threads calling loops also work)
+    vector<_ParallelDeque*>             deques; ///< queue of each worker, then the one of threads outside the pool
+    std::atomic<int>                    queued; ///< tasks in all the queues
+    std::mutex                          sleep_mutex; ///< protects workers going to sleep
+    std::condition_variable             wake; ///< signals workers that tasks were queued
+};
+
+/// threads requested by parallel_set_nthreads (0 for one per core)
+static int _parallel_nthreads_requested = 0;
+/// whether the pool was started
+static std::atomic<bool> _parallel_started(false);
+/// queue of the current thread in the pool (the shared one for threads outside the pool)
+static thread_local int _parallel_deque = -1;
+
+void _parallel_worker(_ParallelPool* pool, int id);
+
+/// the pool, started on first use and never destroyed (workers sleep when idle)
+_ParallelPool* _parallel_pool() {
+    static _ParallelPool* pool = nullptr;
+    static std::once_flag once;
+    std::call_once(once, [](){
+        pool = new _ParallelPool();
+        pool->queued = 0;
+        auto nthreads = (_parallel_nthreads_requested > 0) ? _parallel_nthreads_requested : std::max(1,(int)std::thread::hardware_concurrency());
+        for(int t = 0; t < nthreads; t ++) pool->deques.push_back(new _ParallelDeque());
+        for(int t = 0; t < nthreads-1; t ++) {
+            pool->threads.push_back(std::thread(_parallel_worker, pool, t));
+            pool->threads.back().detach();
+        }
+        _parallel_started = true;
+    });
+    return pool;
+}
+
+/// queue of the current thread
+inline _ParallelDeque* _parallel_own_deque(_ParallelPool* pool) {
+    return pool->deques[(_parallel_deque >= 0) ? _parallel_deque : pool->deques.size()-1];
+}
+
+/// take a task: the last one queued by this thread, or else the oldest one of another thread
+bool _parallel_find_task(_ParallelPool* pool, _ParallelTask& task) {
+    if(not pool->queued) return false;
+    auto own = (_parallel_deque >= 0) ? _parallel_deque : (int)pool->deques.size()-1;
+    auto found = pool->deques[own]->pop(task);
+    for(int d = 1; d < pool->deques.size() and not found; d ++) found = pool->deques[(own + d) % pool->deques.size()]->steal(task);
+    if(found) pool->queued --;
+    return found;
+}
+
+/// run a task and mark it done (the last access to the loop, which may return right after)
+inline void _parallel_run_task(const _ParallelTask& task) {
+    (*task.body)(task.start, task.end);
+    task.pending->fetch_sub(1);
+}
+
+void _parallel_worker(_ParallelPool* pool, int id) {
+    _parallel_deque = id;
+    _ParallelTask task;
+    while(true) {
+        if(_parallel_find_task(pool, task)) { _parallel_run_task(task); continue; }
+        std::unique_lock<std::mutex> lock(pool->sleep_mutex);
+        pool->wake.wait(lock, [pool](){ return pool->queued > 0; });
+    }
+}
+
+/// run body over nchunks ranges of [0,n), queuing all but the first, then running tasks until the loop is done
+void _parallel_run(int n, int nchunks, const function<void (int,int)>& body) {
+    auto pool = _parallel_pool();
+    auto chunk = (n+nchunks-1)/nchunks;
+    nchunks = (n+chunk-1)/chunk;
+    std::atomic<int> pending(nchunks);
+
+    // queued from the last, so that this thread pops them in order while other threads steal the far ones
+    auto deque = _parallel_own_deque(pool);
+    auto queued = 0;
+    for(int c = nchunks-1; c > 0; c --) {
+        auto task = _ParallelTask();
+        task.body = &body; task.start = c*chunk; task.end = std::min(n, (c+1)*chunk); task.pending = &pending;
+        if(deque->push(task)) queued ++;
+        else _parallel_run_task(task);
+    }
+    if(queued) {
+        pool->queued += queued;
+        { std::lock_guard<std::mutex> lock(pool->sleep_mutex); }
+        pool->wake.notify_all();
+    }
+
+    body(0, std::min(n, chunk));
+    pending --;
+
+    // help with any task while other threads finish the ranges of this loop
+    _ParallelTask task;
+    while(pending > 0) {
+        if(_parallel_find_task(pool, task)) _parallel_run_task(task);
+        else std::this_thread::yield();
+    }
+}
+
+void parallel_set_nthreads(int nthreads) {
+    if(_parallel_started) { fprintf(stderr, "warning: parallel threads set after the pool started\n"); return; }
+    _parallel_nthreads_requested = nthreads;
+}
+
+int parallel_nthreads() { return _parallel_pool()->deques.size(); }
+
+void parallel_for(int n, int grain, const function<void (int,int)>& body) {
+    if(n <= 0) return;
+    grain = std::max(1,grain);
+    auto nchunks = std::min((n+grain-1)/grain, parallel_chunks_per_thread*parallel_nthreads());
+    if(nchunks <= 1) { body(0,n); return; }
+    _parallel_run(n, nchunks, body);
+}
+
+void parallel_tasks(int n, const function<void (int)>& task) {
+    if(n <= 0) return;
+    if(n == 1 or parallel_nthreads() == 1) { for(int i = 0; i < n; i ++) task(i); return; }
+    auto body = function<void (int,int)>([&task](int start, int end){ for(int i = start; i < end; i ++) task(i); });
+    _parallel_run(n, n, body);
+}
+
+/// tasks waiting for the background thread
+struct _ParallelBackground {
+    std::deque<function<void ()>>       tasks; ///< tasks in the order queued
+    std::mutex                          mutex; ///< protects the tasks
+    std::condition_variable             wake; ///< signals the thread that tasks were queued
+};
+
+void _parallel_background_worker(_ParallelBackground* background) {
+    while(true) {
+        auto task = function<void ()>();
+        {
+            std::unique_lock<std::mutex> lock(background->mutex);
+            background->wake.wait(lock, [background](){ return not background->tasks.empty(); });
+            task = background->tasks.front();
+            background->tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void parallel_background(const function<void ()>& task) {
+    // started on first use and never destroyed, like the pool
+    static _ParallelBackground* background = nullptr;
+    static std::once_flag once;
+    std::call_once(once, [](){
+        background = new _ParallelBackground();
+        std::thread(_parallel_background_worker, background).detach();
+    });
+    { std::lock_guard<std::mutex> lock(background->mutex); background->tasks.push_back(task); }
+    background->wake.notify_one();
+}
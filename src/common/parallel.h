@@ -0,0 +1,42 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include "std.h"
+
+///@file common/parallel.h Parallel loops. @ingroup common
+///@defgroup parallel Parallel loops
+///@ingroup common
+///@{
+
+///@name parallel parameters
+///@{
+const int parallel_chunks_per_thread = 4; ///< ranges a loop is split in per thread (more balance the load, fewer cost less)
+const int parallel_deque_capacity = 1024; ///< tasks waiting in the queue of a thread (tasks past it run right away)
+///@}
+
+///@name parallel interface
+///@{
+/// set the number of threads used by parallel loops, including the calling one (0 for one per core);
+/// call it before the first loop, since the pool is started then
+void parallel_set_nthreads(int nthreads);
+
+/// number of threads used by parallel loops (including the calling one)
+int parallel_nthreads();
+
+/// call body(start,end) over consecutive ranges that cover [0,n), of at least grain elements each,
+/// as tasks of a pool of persistent work-stealing threads; the calling thread runs tasks too, and returns
+/// when all ranges are done; loops started from inside other loops are split into tasks in the same way,
+/// so that threads left idle by an outer loop help with the inner ones
+void parallel_for(int n, int grain, const function<void (int,int)>& body);
+
+/// call task(i) for i in [0,n), each as a separate task of the pool (for few independent tasks of uneven size)
+void parallel_tasks(int n, const function<void (int)>& task);
+
+/// queue task to run on a background thread and return right away; tasks run one at a time in the order queued,
+/// on a thread of their own (not the pool one, so that long tasks do not hold back parallel loops)
+void parallel_background(const function<void ()>& task);
+///@}
+
+///@}
+
+#endif
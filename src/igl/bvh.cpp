@@ -0,0 +1,147 @@
+#include "bvh.h"
+
+#include <algorithm>
+
+///@file igl/bvh.cpp Bounding Volume Hierarchy. @ingroup igl
+
+/// element record used during build
+struct _BVHBuildElement {
+    range3f     bbox; ///< element bounds
+    vec3f       center; ///< element bounds center
+    int         elementid; ///< element index
+};
+
+/// bounding box surface area (zero for invalid boxes)
+inline float _bvh_bbox_area(const range3f& bbox) {
+    if(not isvalid(bbox)) return 0;
+    auto s = size(bbox);
+    return 2*(s.x*s.y+s.y*s.z+s.z*s.x);
+}
+
+/// find the best binned SAH split of elements [start,end); returns false if no split beats a leaf
+bool _bvh_split_sah(vector<_BVHBuildElement>& build, int start, int end, const range3f& bbox, const range3f& cbbox, int& axis, int& mid) {
+    auto count = end - start;
+    auto area = _bvh_bbox_area(bbox);
+    auto csize = size(cbbox);
+    auto best_cost = (float)count;
+    auto best_axis = -1, best_bin = -1;
+    for(int a = 0; a < 3; a ++) {
+        if(csize[a] <= 0) continue;
+        range3f bin_bbox[bvh_sah_bins]; int bin_count[bvh_sah_bins] = { 0 };
+        for(int i = start; i < end; i ++) {
+            auto b = min(bvh_sah_bins-1, (int)(bvh_sah_bins*(build[i].center[a]-cbbox.min[a])/csize[a]));
+            bin_bbox[b] = runion(bin_bbox[b], build[i].bbox);
+            bin_count[b] ++;
+        }
+        // sweep from the right to get the cost of the right side of each split
+        float right_cost[bvh_sah_bins];
+        range3f right_bbox; int right_count = 0;
+        for(int b = bvh_sah_bins-1; b > 0; b --) {
+            right_bbox = runion(right_bbox, bin_bbox[b]);
+            right_count += bin_count[b];
+            right_cost[b] = right_count*_bvh_bbox_area(right_bbox);
+        }
+        range3f left_bbox; int left_count = 0;
+        for(int b = 1; b < bvh_sah_bins; b ++) {
+            left_bbox = runion(left_bbox, bin_bbox[b-1]);
+            left_count += bin_count[b-1];
+            if(left_count == 0 or left_count == count) continue;
+            auto cost = 0.125f + (left_count*_bvh_bbox_area(left_bbox) + right_cost[b]) / area;
+            if(cost < best_cost) { best_cost = cost; best_axis = a; best_bin = b; }
+        }
+    }
+    if(best_axis < 0) return false;
+
+    axis = best_axis;
+    auto split = std::partition(build.begin()+start, build.begin()+end, [&](const _BVHBuildElement& e){
+        return min(bvh_sah_bins-1, (int)(bvh_sah_bins*(e.center[axis]-cbbox.min[axis])/csize[axis])) < best_bin; });
+    mid = split - build.begin();
+    return true;
+}
+
+/// recursively build node nodeid over elements [start,end)
+void _bvh_build_node(BVH* bvh, vector<_BVHBuildElement>& build, int nodeid, int start, int end, int depth) {
+    range3f bbox, cbbox;
+    for(int i = start; i < end; i ++) {
+        bbox = runion(bbox, build[i].bbox);
+        cbbox = runion(cbbox, build[i].center);
+    }
+    bvh->nodes[nodeid].bbox = bbox;
+
+    auto count = end - start;
+    int axis = 0, mid = -1;
+    if(count > 1) {
+        // past half the depth budget split at the median to guarantee the depth bound
+        if(depth < bvh_depth_max/2 and _bvh_split_sah(build, start, end, bbox, cbbox, axis, mid)) { }
+        else if(count > bvh_leaf_max and depth < bvh_depth_max) {
+            auto csize = size(cbbox);
+            axis = (csize.x >= csize.y and csize.x >= csize.z) ? 0 : ((csize.y >= csize.z) ? 1 : 2);
+            mid = (start + end) / 2;
+            std::nth_element(build.begin()+start, build.begin()+mid, build.begin()+end,
+                             [axis](const _BVHBuildElement& a, const _BVHBuildElement& b){ return a.center[axis] < b.center[axis]; });
+        }
+    }
+
+    if(mid < 0) {
+        bvh->nodes[nodeid].start = start;
+        bvh->nodes[nodeid].count = count;
+        return;
+    }
+
+    auto children = (int)bvh->nodes.size();
+    bvh->nodes.resize(children+2);
+    bvh->nodes[nodeid].start = children;
+    bvh->nodes[nodeid].count = 0;
+    bvh->nodes[nodeid].axis = axis;
+    _bvh_build_node(bvh, build, children+0, start, mid, depth+1);
+    _bvh_build_node(bvh, build, children+1, mid, end, depth+1);
+}
+
+BVH* bvh_build(int nelements, const function<range3f(int)>& element_bounds) {
+    auto bvh = new BVH();
+    if(not nelements) return bvh;
+
+    auto build = vector<_BVHBuildElement>(nelements);
+    for(int i = 0; i < nelements; i ++) {
+        build[i].bbox = element_bounds(i);
+        build[i].center = center(build[i].bbox);
+        build[i].elementid = i;
+    }
+
+    bvh->nodes.reserve(2*nelements);
+    bvh->nodes.resize(1);
+    _bvh_build_node(bvh, build, 0, 0, nelements, 0);
+
+    bvh->elements.resize(nelements);
+    for(int i = 0; i < nelements; i ++) bvh->elements[i] = build[i].elementid;
+    bvh->_build_cost = bvh_cost(bvh);
+    return bvh;
+}
+
+bool bvh_refit(BVH* bvh, const function<range3f(int)>& element_bounds, float rebuild_threshold) {
+    // children are stored after their parents, so a reverse sweep updates the tree bottom-up
+    for(int n = (int)bvh->nodes.size()-1; n >= 0; n --) {
+        auto& node = bvh->nodes[n];
+        if(node.count) {
+            range3f bbox;
+            for(int i = node.start; i < node.start + node.count; i ++) bbox = runion(bbox, element_bounds(bvh->elements[i]));
+            node.bbox = bbox;
+        }
+        else node.bbox = runion(bvh->nodes[node.start].bbox, bvh->nodes[node.start+1].bbox);
+    }
+    
+    if(rebuild_threshold <= 0 or bvh_cost(bvh) <= rebuild_threshold * bvh->_build_cost) return false;
+    auto rebuilt = bvh_build(bvh->elements.size(), element_bounds);
+    swap(*bvh, *rebuilt);
+    delete rebuilt;
+    return true;
+}
+
+float bvh_cost(BVH* bvh) {
+    if(bvh->nodes.empty()) return 0;
+    auto root_area = _bvh_bbox_area(bvh->nodes[0].bbox);
+    if(root_area <= 0) return 0;
+    auto cost = 0.0f;
+    for(auto& node : bvh->nodes) cost += _bvh_bbox_area(node.bbox) / root_area * ((node.count) ? node.count : 0.125f);
+    return cost;
+}
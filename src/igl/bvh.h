@@ -0,0 +1,229 @@
+#ifndef _BVH_H_
+#define _BVH_H_
+
+#include "vmath/vmath.h"
+#include "common/std.h"
+
+#include <cstdint>
+
+///@file igl/bvh.h Bounding Volume Hierarchy. @ingroup igl
+///@defgroup bvh Bounding Volume Hierarchy
+///@ingroup igl
+///@{
+
+/// BVH node: leaves reference a range of elements, internal nodes their two consecutive children
+struct BVHNode {
+    range3f             bbox; ///< node bounds
+    int                 start = 0; ///< first element index (leaf) or first child node (internal)
+    int                 count = 0; ///< number of elements (0 for internal nodes)
+    int                 axis = 0; ///< split axis (internal nodes), used to order traversal
+};
+
+/// Bounding Volume Hierarchy over a set of elements identified by their index
+struct BVH {
+    vector<BVHNode>     nodes; ///< nodes (root first, children are always stored after their parent)
+    vector<int>         elements; ///< element indices, sorted by leaf
+    
+    float               _build_cost = 0; ///< tree cost right after the build (to detect refit degradation)
+};
+
+/// Ray packet traversal statistics (accumulated over calls)
+struct BVHPacketStats {
+    long                packets = 0; ///< packets traced
+    long                rays = 0; ///< rays traced
+    long                nodes = 0; ///< nodes visited
+    long                nodes_culled = 0; ///< nodes rejected for the whole packet by the interval test
+    long                ray_bbox_tests = 0; ///< single ray-box tests
+    long                ray_element_tests = 0; ///< single ray-element tests
+};
+
+///@name bvh parameters
+///@{
+const int bvh_leaf_max = 4; ///< elements in a leaf that forces a split if possible
+const int bvh_sah_bins = 16; ///< number of bins used by the SAH builder
+const int bvh_depth_max = 64; ///< maximum tree depth (also the traversal stack size)
+const int bvh_packet_size = 64; ///< maximum number of rays in a packet (one bit each in the active mask)
+///@}
+
+///@name bvh interface
+///@{
+BVH* bvh_build(int nelements, const function<range3f(int)>& element_bounds);
+/// update node bounds bottom-up keeping the tree topology; if rebuild_threshold > 0 and
+/// the tree cost grew past rebuild_threshold times the build cost, rebuild it instead; returns whether it rebuilt
+bool bvh_refit(BVH* bvh, const function<range3f(int)>& element_bounds, float rebuild_threshold = 0);
+/// surface area heuristic cost of the tree (relative to the root area)
+float bvh_cost(BVH* bvh);
+///@}
+
+/// traverse the BVH front to back calling intersect_element(elementid) for the elements whose bounds overlap the ray;
+/// intersect_element returns whether it hit and may shrink ray.tmax to prune the rest of the traversal;
+/// if any is true, traversal stops at the first hit
+template<typename F>
+inline bool bvh_intersect(BVH* bvh, ray3f& ray, bool any, const F& intersect_element) {
+    if(bvh->nodes.empty()) return false;
+    auto ray_dinv = vec3f(1/ray.d.x,1/ray.d.y,1/ray.d.z);
+    bool ray_dneg[3] = { ray.d.x < 0, ray.d.y < 0, ray.d.z < 0 };
+
+    bool hit = false;
+    int stack[bvh_depth_max+1]; int stack_size = 0;
+    stack[stack_size++] = 0;
+    while(stack_size) {
+        auto& node = bvh->nodes[stack[--stack_size]];
+        if(not intersect_bbox(ray, ray_dinv, node.bbox)) continue;
+        if(node.count) {
+            for(int i = node.start; i < node.start + node.count; i ++) {
+                if(not intersect_element(bvh->elements[i])) continue;
+                hit = true;
+                if(any) return true;
+            }
+        } else {
+            // push the far child first so that the near one is visited first
+            if(ray_dneg[node.axis]) { stack[stack_size++] = node.start; stack[stack_size++] = node.start+1; }
+            else { stack[stack_size++] = node.start+1; stack[stack_size++] = node.start; }
+        }
+    }
+    return hit;
+}
+
+/// traverse the BVH like bvh_intersect, but testing the two children of each node together with intersect_bboxes8
+/// and calling intersect_leaf(node) once per leaf, so that the leaf elements can be tested together too;
+/// children are visited by entry distance and skipped if ray.tmax shrank past it after they were pushed
+template<typename F>
+inline bool bvh_intersect_leaves(BVH* bvh, ray3f& ray, bool any, const F& intersect_leaf) {
+    if(bvh->nodes.empty()) return false;
+    auto ray_dinv = vec3f(1/ray.d.x,1/ray.d.y,1/ray.d.z);
+    if(not intersect_bbox(ray, ray_dinv, bvh->nodes[0].bbox)) return false;
+
+    bool hit = false;
+    bboxes8f children = {}; float children_t[8];
+    int stack[bvh_depth_max+1]; float stack_t[bvh_depth_max+1]; int stack_size = 0;
+    stack[stack_size] = 0; stack_t[stack_size++] = ray.tmin;
+    while(stack_size) {
+        stack_size --;
+        if(stack_t[stack_size] > ray.tmax) continue;
+        auto& node = bvh->nodes[stack[stack_size]];
+        if(node.count) {
+            if(not intersect_leaf(node)) continue;
+            hit = true;
+            if(any) return true;
+        } else {
+            for(int c = 0; c < 2; c ++) {
+                auto& bbox = bvh->nodes[node.start+c].bbox;
+                for(int i = 0; i < 3; i ++) { children.min[i][c] = bbox.min[i]; children.max[i][c] = bbox.max[i]; }
+            }
+            auto mask = intersect_bboxes8(ray, ray_dinv, children, 2, children_t);
+            // push the far child first so that the near one is visited first
+            int order = (mask == 3 and children_t[1] < children_t[0]) ? 1 : 0;
+            for(int c = 1; c >= 0; c --) {
+                auto l = c ^ order;
+                if(not (mask & (1 << l))) continue;
+                stack[stack_size] = node.start+l; stack_t[stack_size++] = children_t[l];
+            }
+        }
+    }
+    return hit;
+}
+
+/// traverse the BVH calling overlap_element(elementid) for the elements whose bounds overlap bbox;
+/// overlap_element may shrink bbox to prune the rest of the traversal (ex: to the distance of the closest element so far)
+template<typename F>
+inline void bvh_overlap(BVH* bvh, range3f& bbox, const F& overlap_element) {
+    if(bvh->nodes.empty()) return;
+    int stack[bvh_depth_max+1]; int stack_size = 0;
+    stack[stack_size++] = 0;
+    while(stack_size) {
+        auto& node = bvh->nodes[stack[--stack_size]];
+        if(not overlap(node.bbox, bbox)) continue;
+        if(node.count) {
+            for(int i = node.start; i < node.start + node.count; i ++) overlap_element(bvh->elements[i]);
+        } else {
+            stack[stack_size++] = node.start+1;
+            stack[stack_size++] = node.start;
+        }
+    }
+}
+
+/// index of the lowest active ray in a non-empty packet mask
+inline int bvh_packet_lowest(uint64_t mask) { return __builtin_ctzll(mask); }
+
+/// traverse the BVH with a packet of n (<= bvh_packet_size) rays, of which only the ones in mask are active,
+/// calling intersect_element(elementid, raymask) for the elements whose bounds overlap any of the rays in raymask;
+/// intersect_element may shrink the rays tmax to prune the rest of the traversal;
+/// when all the active rays have the same direction signs, nodes are first tested with interval arithmetic
+/// over the whole packet, so that nodes missed by all rays are culled without testing each ray
+template<typename F>
+inline void bvh_intersect_packet(BVH* bvh, ray3f* rays, int n, uint64_t mask, const F& intersect_element, BVHPacketStats* stats = nullptr) {
+    if(bvh->nodes.empty() or not mask) return;
+
+    // rays in structure-of-arrays layout for the per-ray box tests
+    float ray_e[3][bvh_packet_size], ray_dinv[3][bvh_packet_size], ray_tmin[bvh_packet_size];
+    // packet intervals for the culling test
+    range3f packet_e, packet_dinv; range1f packet_tmin, packet_tmax;
+    bool interval = true; int first = -1;
+    for(int r = 0; r < n; r ++) {
+        if(not (mask & (uint64_t(1) << r))) continue;
+        auto dinv = vec3f(1/rays[r].d.x,1/rays[r].d.y,1/rays[r].d.z);
+        for(int i = 0; i < 3; i ++) { ray_e[i][r] = rays[r].e[i]; ray_dinv[i][r] = dinv[i]; }
+        ray_tmin[r] = rays[r].tmin;
+        if(first < 0) first = r;
+        for(int i = 0; i < 3; i ++) interval = interval and std::isfinite(dinv[i]) and ((dinv[i] < 0) == (ray_dinv[i][first] < 0));
+        packet_e = runion(packet_e, rays[r].e);
+        packet_dinv = runion(packet_dinv, dinv);
+        packet_tmin = runion(packet_tmin, rays[r].tmin);
+        packet_tmax = runion(packet_tmax, rays[r].tmax);
+    }
+    bool ray_dneg[3] = { ray_dinv[0][first] < 0, ray_dinv[1][first] < 0, ray_dinv[2][first] < 0 };
+
+    int stack[bvh_depth_max+1]; uint64_t stack_mask[bvh_depth_max+1]; int stack_size = 0;
+    stack[stack_size] = 0; stack_mask[stack_size++] = mask;
+    while(stack_size) {
+        stack_size --;
+        auto& node = bvh->nodes[stack[stack_size]];
+        auto node_mask = stack_mask[stack_size];
+        if(stats) stats->nodes ++;
+        
+        // interval test: bounds of the entry and exit distances of all rays (tmax only shrinks, so its initial bound holds)
+        if(interval) {
+            auto tnear = packet_tmin.min, tfar = packet_tmax.max;
+            for(int i = 0; i < 3; i ++) {
+                auto near = (ray_dneg[i]) ? node.bbox.max[i] : node.bbox.min[i];
+                auto far = (ray_dneg[i]) ? node.bbox.min[i] : node.bbox.max[i];
+                auto n0 = near - packet_e.max[i], n1 = near - packet_e.min[i];
+                auto f0 = far - packet_e.max[i], f1 = far - packet_e.min[i];
+                tnear = max(tnear, min(min(n0*packet_dinv.min[i],n0*packet_dinv.max[i]),min(n1*packet_dinv.min[i],n1*packet_dinv.max[i])));
+                tfar = min(tfar, max(max(f0*packet_dinv.min[i],f0*packet_dinv.max[i]),max(f1*packet_dinv.min[i],f1*packet_dinv.max[i]))*1.0000004f);
+            }
+            if(tnear > tfar) { if(stats) stats->nodes_culled ++; continue; }
+        }
+        
+        // per-ray test, written over arrays so that it can run in SIMD lanes when vectorized
+        uint64_t hit_mask = 0;
+        for(auto m = node_mask; m; m &= m-1) {
+            auto r = bvh_packet_lowest(m);
+            auto t0 = ray_tmin[r], t1 = rays[r].tmax;
+            for(int i = 0; i < 3; i ++) {
+                auto ta = (node.bbox.min[i] - ray_e[i][r]) * ray_dinv[i][r];
+                auto tb = (node.bbox.max[i] - ray_e[i][r]) * ray_dinv[i][r];
+                if(ta > tb) std::swap(ta, tb);
+                tb *= 1.0000004f;
+                t0 = ta > t0 ? ta : t0;
+                t1 = tb < t1 ? tb : t1;
+            }
+            if(t0 <= t1) hit_mask |= uint64_t(1) << r;
+            if(stats) stats->ray_bbox_tests ++;
+        }
+        if(not hit_mask) continue;
+        
+        if(node.count) {
+            for(int i = node.start; i < node.start + node.count; i ++) intersect_element(bvh->elements[i], hit_mask);
+        } else {
+            // push the far child first so that the near one is visited first
+            stack_mask[stack_size] = hit_mask; stack[stack_size++] = (ray_dneg[node.axis]) ? node.start : node.start+1;
+            stack_mask[stack_size] = hit_mask; stack[stack_size++] = (ray_dneg[node.axis]) ? node.start+1 : node.start;
+        }
+    }
+}
+
+///@}
+
+#endif
@@ -3,6 +3,10 @@
 #include "gls.h"
 #include "gl_utils.h"
 #include "serialize.h"
+#include "intersect.h"
+#include "tesselate.h"
+
+#include <limits>
 
 ///@file igl/draw.cpp Interactive Drawing. @ingroup igl
 
@@ -98,28 +102,120 @@ void draw_material(Material* mat) {
     else not_implemented_error();
 }
 
+ShapeDrawBuffers::~ShapeDrawBuffers() {
+    if(vertex) glDeleteBuffers(1, &vertex);
+    if(index) glDeleteBuffers(1, &index);
+}
+
+/// vertices of a mesh per face corner, with either the vertex normal or the face one (flat shading),
+/// and either the vertex texcoord or the corner one
+void _draw_corner_vertices(const vector<vec3f>& pos, const vector<vec3f>& norm, const vector<vec2f>& texcoord,
+                           const vector<vec3i>& triangle, const vector<vec4i>& quad,
+                           vector<vec3f>& corner_pos, vector<vec3f>& corner_norm, vector<vec2f>& corner_texcoord) {
+    vec2f triangleuv[3] = { {0,0}, {1,0}, {0,1} };
+    vec2f quaduv[4] = { {0,0}, {1,0}, {1,1}, {0,1} };
+    for(auto f : triangle) {
+        auto n = (norm.empty()) ? triangle_normal(pos[f.x],pos[f.y],pos[f.z]) : zero3f;
+        for(auto c : range(3)) {
+            corner_pos.push_back(pos[f[c]]);
+            corner_norm.push_back((norm.empty()) ? n : norm[f[c]]);
+            corner_texcoord.push_back((texcoord.empty()) ? triangleuv[c] : texcoord[f[c]]);
+        }
+    }
+    for(auto f : quad) {
+        auto n = (norm.empty()) ? quad_normal(pos[f.x],pos[f.y],pos[f.z],pos[f.w]) : zero3f;
+        for(auto c : range(4)) {
+            corner_pos.push_back(pos[f[c]]);
+            corner_norm.push_back((norm.empty()) ? n : norm[f[c]]);
+            corner_texcoord.push_back((texcoord.empty()) ? quaduv[c] : texcoord[f[c]]);
+        }
+    }
+}
+
+/// draw a mesh from its draw buffers, uploading its vertex data if new or changed (see ShapeDrawBuffers)
+void _draw_mesh_buffers(Shape* shape, const vector<vec3f>& pos, const vector<vec3f>& norm, const vector<vec2f>& texcoord,
+                        const vector<vec3i>& triangle, const vector<vec4i>& quad) {
+    if(triangle.empty() and quad.empty()) return;
+    glsCheckError();
+    if(not shape->_draw_buffers) shape->_draw_buffers = new ShapeDrawBuffers();
+    auto buffers = shape->_draw_buffers;
+
+    // flat shading needs the face normals and meshes without texcoords the corner ones, so their vertices are per face corner
+    auto corners = norm.empty() or texcoord.empty();
+    auto nvertices = (corners) ? (int)(3*triangle.size() + 4*quad.size()) : (int)pos.size();
+    auto resized = not buffers->vertex or buffers->corners != corners or buffers->nvertices != nvertices or
+                   buffers->ntriangles != triangle.size() or buffers->nquads != quad.size();
+    if(resized or buffers->changes != shape->_changes) {
+        auto corner_pos = vector<vec3f>(), corner_norm = vector<vec3f>();
+        auto corner_texcoord = vector<vec2f>();
+        if(corners) _draw_corner_vertices(pos, norm, texcoord, triangle, quad, corner_pos, corner_norm, corner_texcoord);
+        auto& vertex_pos = (corners) ? corner_pos : pos;
+        auto& vertex_norm = (corners) ? corner_norm : norm;
+        auto& vertex_texcoord = (corners) ? corner_texcoord : texcoord;
+        auto size3 = nvertices*sizeof(vec3f);
+        if(resized) {
+            if(not buffers->vertex) glGenBuffers(1, &buffers->vertex);
+            glBindBuffer(GL_ARRAY_BUFFER, buffers->vertex);
+            // meshes that were already changed will likely change again
+            glBufferData(GL_ARRAY_BUFFER, 2*size3 + nvertices*sizeof(vec2f), nullptr, (shape->_changes) ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 2*size3, nvertices*sizeof(vec2f), vertex_texcoord.data());
+            if(not corners) {
+                if(not buffers->index) glGenBuffers(1, &buffers->index);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers->index);
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, triangle.size()*sizeof(vec3i) + quad.size()*sizeof(vec4i), nullptr, GL_STATIC_DRAW);
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, triangle.size()*sizeof(vec3i), triangle.data());
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, triangle.size()*sizeof(vec3i), quad.size()*sizeof(vec4i), quad.data());
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+            }
+        }
+        else glBindBuffer(GL_ARRAY_BUFFER, buffers->vertex);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size3, vertex_pos.data());
+        glBufferSubData(GL_ARRAY_BUFFER, size3, size3, vertex_norm.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        buffers->changes = shape->_changes;
+        buffers->nvertices = nvertices;
+        buffers->ntriangles = triangle.size();
+        buffers->nquads = quad.size();
+        buffers->corners = corners;
+    }
+
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers->vertex);
+    glEnableClientState(GL_VERTEX_ARRAY); glVertexPointer(3, GL_FLOAT, 0, (void*)0);
+    glEnableClientState(GL_NORMAL_ARRAY); glNormalPointer(GL_FLOAT, 0, (void*)(nvertices*sizeof(vec3f)));
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY); glTexCoordPointer(2, GL_FLOAT, 0, (void*)(2*nvertices*sizeof(vec3f)));
+    if(corners) {
+        if(not triangle.empty()) glDrawArrays(GL_TRIANGLES, 0, 3*triangle.size());
+        if(not quad.empty()) glDrawArrays(GL_QUADS, 3*triangle.size(), 4*quad.size());
+    } else {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers->index);
+        if(not triangle.empty()) glDrawElements(GL_TRIANGLES, 3*triangle.size(), GL_UNSIGNED_INT, (void*)0);
+        if(not quad.empty()) glDrawElements(GL_QUADS, 4*quad.size(), GL_UNSIGNED_INT, (void*)(triangle.size()*sizeof(vec3i)));
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glPopClientAttrib();
+    glsCheckError();
+}
+
 void draw_shape(Shape* shape) {
     if(shape->_tesselation) return draw_shape(shape->_tesselation);
         
     if(is<PointSet>(shape)) {
         auto points = cast<PointSet>(shape);
+        if(points->pos.empty()) return;
         if(points->approximate) {
             glPointSize(points->approximate_radius);
             //glEnable(GL_POINT_SPRITE);
-            glBegin(GL_POINTS);
-            for(auto i : range(points->pos.size())) {
-                if(not points->texcoord.empty()) glsTexCoord(points->texcoord[i]); else glsTexCoord(zero2f);
-                glsNormal(z3f);
-                glsVertex(points->pos[i]);
-            }
-            glEnd();
+            glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+            glEnableClientState(GL_VERTEX_ARRAY); glsVertexPointer(points->pos);
+            if(not points->texcoord.empty()) { glEnableClientState(GL_TEXTURE_COORD_ARRAY); glsTexCoordPointer(points->texcoord); }
+            else glsTexCoord(zero2f);
+            glsNormal(z3f);
+            glDrawArrays(GL_POINTS, 0, points->pos.size());
+            glPopClientAttrib();
             //glDisable(GL_POINT_SPRITE);
-        } else {
-            for(int i = 0; i < points->pos.size(); i ++) {
-                if(not points->texcoord.empty()) glutils_draw_sphere(points->pos[i],points->radius[i],points->texcoord[i],4,4);
-                else glutils_draw_sphere(points->pos[i],points->radius[i],zero2f,4,4);
-            }
-        }
+        } else glutils_draw_spheres(points->pos,points->radius,points->texcoord,4,4);
     }
     else if(is<LineSet>(shape)) {
         auto lines = cast<LineSet>(shape);
@@ -147,84 +243,13 @@ void draw_shape(Shape* shape) {
     }
     else if(is<TriangleMesh>(shape)) {
         auto mesh = cast<TriangleMesh>(shape);
-        if(mesh->norm.empty() or mesh->texcoord.empty()) {
-            vec2f triangleuv[3] = { {0,0}, {1,0}, {0,1} };
-            glBegin(GL_TRIANGLES);
-            for(auto f : mesh->triangle) {
-                if(mesh->norm.empty()) glsNormal(triangle_normal(mesh->pos[f.x],mesh->pos[f.y],mesh->pos[f.z]));
-                int uvcount = 0;
-                for(auto vid : f) {
-                    if(not mesh->texcoord.empty()) glsTexCoord(mesh->texcoord[vid]); else glsTexCoord(triangleuv[uvcount++]);
-                    if(not mesh->norm.empty()) glsNormal(mesh->norm[vid]);
-                    glsVertex(mesh->pos[vid]);
-                }
-            }
-            glEnd();
-        } else {
-            glutils_draw_faces(mesh->triangle, mesh->pos, mesh->norm, mesh->texcoord);
-        }
+        _draw_mesh_buffers(shape, mesh->pos, mesh->norm, mesh->texcoord, mesh->triangle, vector<vec4i>());
     }
     else if(is<Mesh>(shape)) {
         auto mesh = cast<Mesh>(shape);
-        if(mesh->norm.empty() or mesh->texcoord.empty()) {
-            vec2f triangleuv[3] = { {0,0}, {1,0}, {0,1} };
-            vec2f quaduv[4] = { {0,0}, {1,0}, {1,1}, {0,1} };
-            glBegin(GL_TRIANGLES);
-            for(auto f : mesh->triangle) {
-                if(mesh->norm.empty()) glsNormal(triangle_normal(mesh->pos[f.x],mesh->pos[f.y],mesh->pos[f.z]));
-                int uvcount = 0;
-                for(auto vid : f) {
-                    if(not mesh->texcoord.empty()) glsTexCoord(mesh->texcoord[vid]); else glsTexCoord(triangleuv[uvcount++]);
-                    if(not mesh->norm.empty()) glsNormal(mesh->norm[vid]);
-                    glsVertex(mesh->pos[vid]);
-                }
-            }
-            glEnd();
-            glBegin(GL_QUADS);
-            for(auto f : mesh->quad) {
-                if(mesh->norm.empty()) glsNormal(quad_normal(mesh->pos[f.x],mesh->pos[f.y],mesh->pos[f.z],mesh->pos[f.w]));
-                int uvcount = 0;
-                for(auto vid : f) {
-                    if(not mesh->texcoord.empty()) glsTexCoord(mesh->texcoord[vid]); else glsTexCoord(quaduv[uvcount++]);
-                    if(not mesh->norm.empty()) glsNormal(mesh->norm[vid]);
-                    glsVertex(mesh->pos[vid]);
-                }
-            }
-            glEnd();
-        } else {
-            if(not mesh->triangle.empty()) glutils_draw_faces(mesh->triangle, mesh->pos, mesh->norm, mesh->texcoord);
-            if(not mesh->quad.empty()) glutils_draw_faces(mesh->quad, mesh->pos, mesh->norm, mesh->texcoord);
-        }
-    }
-    else if(is<FaceMesh>(shape)) {
-        auto mesh = cast<FaceMesh>(shape);
-        vec2f triangleuv[3] = { {0,0}, {1,0}, {0,1} };
-        vec2f quaduv[4] = { {0,0}, {1,0}, {1,1}, {0,1} };
-        glBegin(GL_TRIANGLES);
-        for(auto f : mesh->triangle) {
-            if(mesh->norm.empty()) glsNormal(triangle_normal(mesh->pos[mesh->vertex[f.x].x],mesh->pos[mesh->vertex[f.y].x],mesh->pos[mesh->vertex[f.z].x]));
-            int uvcount = 0;
-            for(auto vid : f) {
-                auto v = mesh->vertex[vid];
-                if(not mesh->texcoord.empty()) glsTexCoord(mesh->texcoord[v.z]); else glsTexCoord(triangleuv[uvcount++]);
-                if(not mesh->norm.empty()) glsNormal(mesh->norm[v.y]);
-                glsVertex(mesh->pos[v.x]);
-            }
-        }
-        glEnd();
-        glBegin(GL_QUADS);
-        for(auto f : mesh->quad) {
-            if(mesh->norm.empty()) glsNormal(quad_normal(mesh->pos[mesh->vertex[f.x].x],mesh->pos[mesh->vertex[f.y].x],mesh->pos[mesh->vertex[f.z].x],mesh->pos[mesh->vertex[f.w].x]));
-            int uvcount = 0;
-            for(auto vid : f) {
-                auto v = mesh->vertex[vid];
-                if(not mesh->texcoord.empty()) glsTexCoord(mesh->texcoord[v.z]); else glsTexCoord(quaduv[uvcount++]);
-                if(not mesh->norm.empty()) glsNormal(mesh->norm[v.y]);
-                glsVertex(mesh->pos[v.x]);
-            }
-        }
-        glEnd();
+        _draw_mesh_buffers(shape, mesh->pos, mesh->norm, mesh->texcoord, mesh->triangle, mesh->quad);
     }
+    else if(is<FaceMesh>(shape)) draw_shape(facemesh_mesh(cast<FaceMesh>(shape)));
     else if(is<Sphere>(shape)) glutils_draw_sphere(cast<Sphere>(shape)->center,cast<Sphere>(shape)->radius);
     else if(is<Cylinder>(shape)) glutils_draw_cylinder(cast<Cylinder>(shape)->radius,cast<Cylinder>(shape)->height);
     else if(is<Quad>(shape)) glutils_draw_quad(zero3f,x3f,y3f,cast<Quad>(shape)->width,cast<Quad>(shape)->height);
@@ -375,16 +400,24 @@ void draw_shape_decorations(Shape* shape, bool edges, bool lines, bool control)
     else { }
 }
 
-void draw_primitive(Primitive* prim, float time) {
+/// draw a shape spanning pixels on screen at the level of detail with tesselation edges of about edge_pixels
+/// (the full detail for 0)
+inline void _draw_shape_lod(Shape* shape, float pixels, float edge_pixels) {
+    if(edge_pixels > 0 and shape->_levels) draw_shape(shape_tesselation_lod(shape, shape_tesselation_lod_level(shape, pixels, edge_pixels)));
+    else draw_shape(shape);
+}
+
+/// draw a primitive spanning pixels on screen, with its shape at the level of detail for edge_pixels (see _draw_shape_lod)
+void draw_primitive(Primitive* prim, float time, float pixels, float edge_pixels) {
     glPushMatrix();
     glPushAttrib(GL_TEXTURE_BIT);
     glsMultMatrix(frame_to_matrix(prim->frame));
     draw_material(prim->material);
-    if(is<Surface>(prim)) draw_shape(cast<Surface>(prim)->shape);
+    if(is<Surface>(prim)) _draw_shape_lod(cast<Surface>(prim)->shape, pixels, edge_pixels);
     else if(is<TransformedSurface>(prim)) {
         auto transformed = cast<TransformedSurface>(prim);
         glsMultMatrix(transformed_matrix(transformed, time));
-        draw_shape(transformed->shape);
+        _draw_shape_lod(transformed->shape, pixels, edge_pixels);
     }
     else if(is<SkinnedSurface>(prim)) {
         auto skinned = cast<SkinnedSurface>(prim);
@@ -400,8 +433,120 @@ void draw_primitive(Primitive* prim, float time) {
     glPopMatrix();
 }
 
-void draw_primitives(PrimitiveGroup* group, float time) {
-    for(auto p : group->prims) draw_primitive(p,time);
+/// culling state of a primitive
+enum { _draw_visible = 0, _draw_culled_frustum = 1, _draw_culled_small = 2 };
+
+/// view frustum of a camera, as the planes bounding the clip volume (inside where dot(plane,[p,1]) >= 0)
+struct _DrawFrustum {
+    mat4f       viewprojection; ///< projection times view matrix
+    vec4f       planes[6]; ///< left, right, bottom, top, near, far
+    vec2f       viewport; ///< half image size in pixels
+};
+
+/// frustum of the camera for an image of w x h pixels (planes extracted from the rows of the clip transform)
+_DrawFrustum _draw_frustum(Camera* camera, int w, int h) {
+    auto frustum = _DrawFrustum();
+    auto& m = frustum.viewprojection;
+    m = camera_projectionmatrix(camera) * camera_viewmatrix(camera);
+    frustum.planes[0] = m.w + m.x; frustum.planes[1] = m.w - m.x;
+    frustum.planes[2] = m.w + m.y; frustum.planes[3] = m.w - m.y;
+    frustum.planes[4] = m.w + m.z; frustum.planes[5] = m.w - m.z;
+    frustum.viewport = vec2f(w/2.0f,h/2.0f);
+    return frustum;
+}
+
+/// test a bounding box against the frustum: -1 if outside, 1 if inside, 0 if crossing the frustum boundary
+int _draw_frustum_test(const _DrawFrustum& frustum, const range3f& bbox) {
+    auto inside = 1;
+    for(auto& plane : frustum.planes) {
+        // corners farthest along and against the plane normal
+        auto pmax = vec3f((plane.x >= 0) ? bbox.max.x : bbox.min.x, (plane.y >= 0) ? bbox.max.y : bbox.min.y, (plane.z >= 0) ? bbox.max.z : bbox.min.z);
+        auto pmin = vec3f((plane.x >= 0) ? bbox.min.x : bbox.max.x, (plane.y >= 0) ? bbox.min.y : bbox.max.y, (plane.z >= 0) ? bbox.min.z : bbox.max.z);
+        if(dot(plane, vec4f(pmax.x,pmax.y,pmax.z,1)) < 0) return -1;
+        if(dot(plane, vec4f(pmin.x,pmin.y,pmin.z,1)) < 0) inside = 0;
+    }
+    return inside;
+}
+
+/// pixels spanned on screen by the projection of a bounding box (infinite for boxes crossing the camera plane)
+float _draw_frustum_pixels(const _DrawFrustum& frustum, const range3f& bbox) {
+    auto screen = range2f();
+    for(auto corner : corners(bbox)) {
+        auto p = frustum.viewprojection * vec4f(corner.x,corner.y,corner.z,1);
+        if(p.w <= 0) return std::numeric_limits<float>::infinity();
+        screen = runion(screen, vec2f(p.x/p.w,p.y/p.w));
+    }
+    return max(size(screen).x*frustum.viewport.x, size(screen).y*frustum.viewport.y);
+}
+
+/// culling state of a primitive with bounds bbox, already known to be inside the frustum if inside is set
+inline int _draw_cull(const _DrawFrustum& frustum, Primitive* prim, const range3f& bbox, bool inside, const DrawOptions& opts) {
+    // skinned bounds are the ones of the last posed time, not the drawn one
+    if(is<SkinnedSurface>(prim)) return _draw_visible;
+    if(opts.cull and not inside and _draw_frustum_test(frustum, bbox) < 0) return _draw_culled_frustum;
+    if(opts.cull_pixels > 0 and _draw_frustum_pixels(frustum, bbox) < opts.cull_pixels) return _draw_culled_small;
+    return _draw_visible;
+}
+
+/// set the culling state of the primitives by traversing the group acceleration structure: subtrees outside
+/// the frustum are culled at once, while the ones inside skip the frustum tests of their primitives
+void _draw_cull_bvh(PrimitiveGroup* group, const _DrawFrustum& frustum, const DrawOptions& opts, vector<char>& culled) {
+    auto bvh = group->_bvh;
+    if(bvh->nodes.empty()) return;
+    int stack[bvh_depth_max+1]; bool stack_inside[bvh_depth_max+1]; int stack_size = 0;
+    stack[stack_size] = 0; stack_inside[stack_size++] = not opts.cull;
+    while(stack_size) {
+        stack_size --;
+        auto& node = bvh->nodes[stack[stack_size]];
+        auto inside = stack_inside[stack_size];
+        if(not inside) {
+            auto test = _draw_frustum_test(frustum, node.bbox);
+            if(test < 0) continue;
+            inside = test > 0;
+        }
+        if(node.count) {
+            for(int i = node.start; i < node.start + node.count; i ++) {
+                auto primid = bvh->elements[i];
+                culled[primid] = _draw_cull(frustum, group->prims[primid], group->_bounds[primid], inside, opts);
+            }
+        } else {
+            stack[stack_size] = node.start+1; stack_inside[stack_size++] = inside;
+            stack[stack_size] = node.start; stack_inside[stack_size++] = inside;
+        }
+    }
+}
+
+/// draw the primitives of a group in order, skipping the ones culled as set in opts, and with the levels of detail
+/// for their size on screen
+void draw_primitives(PrimitiveGroup* group, const _DrawFrustum& frustum, const DrawOptions& opts, DrawStats* stats) {
+    // culling state of each primitive, kept in the group so that nested groups draws do not share it; primitives
+    // are not visited by the tree traversal if their subtree is outside the frustum, so they start as culled
+    // (but skinned ones, never culled)
+    auto& culled = group->_draw_culled;
+    auto do_cull = opts.cull or opts.cull_pixels > 0;
+    culled.resize(group->prims.size());
+    for(int primid = 0; primid < group->prims.size(); primid ++)
+        culled[primid] = (do_cull and not is<SkinnedSurface>(group->prims[primid])) ? _draw_culled_frustum : _draw_visible;
+    if(do_cull) {
+        if(group->_bvh and group->_bvh->elements.size() == group->prims.size()) _draw_cull_bvh(group, frustum, opts, culled);
+        else {
+            auto& bounds = intersect_primitives_element_bounds(group);
+            for(int primid = 0; primid < group->prims.size(); primid ++)
+                culled[primid] = _draw_cull(frustum, group->prims[primid], bounds[primid], false, opts);
+        }
+    }
+    if(stats) *stats = DrawStats();
+    auto bounds = (opts.lod_pixels > 0) ? &intersect_primitives_element_bounds(group) : nullptr;
+    for(int primid = 0; primid < group->prims.size(); primid ++) {
+        if(culled[primid] == _draw_visible) {
+            auto pixels = (bounds) ? _draw_frustum_pixels(frustum, (*bounds)[primid]) : 0.0f;
+            draw_primitive(group->prims[primid], opts.time, pixels, opts.lod_pixels);
+        }
+        if(not stats) continue;
+        if(culled[primid] == _draw_visible) stats->drawn ++;
+        else if(culled[primid] == _draw_culled_frustum) stats->culled_frustum ++;
+        else stats->culled_small ++;
+    }
 }
 
 void draw_primitive_decorations(Primitive* prim, float time,
@@ -486,7 +631,7 @@ void draw_gizmos(GizmoGroup* group) {
 }
 
 void draw_scene(Scene* scene,
-                const DrawOptions& opts, bool clear) {
+                const DrawOptions& opts, bool clear, DrawStats* stats) {
     int w = camera_image_width(scene->camera,opts.res);
     int h = camera_image_height(scene->camera,opts.res);
     
@@ -506,7 +651,8 @@ void draw_scene(Scene* scene,
     
     draw_lights((opts.cameralights) ? scene->_cameralights : scene->lights,opts.ambient,opts.doublesided);
     
-    if(opts.faces) draw_primitives(scene->prims,opts.time);
+    if(opts.faces) draw_primitives(scene->prims,_draw_frustum(scene->camera,w,h),opts,stats);
+    else if(stats) *stats = DrawStats();
 
     // pop lighting attribs
     glPopAttrib();
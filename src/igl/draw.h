@@ -19,7 +19,7 @@ struct DrawOptions : Node {
     vec3f   background = vec3f(0.25,0.25,0.25); ///< image background
     
     bool    cameralights = true; ///< whether to use camera lights
-    vec3f   ambient = {0.1,0.1,0.1}; ///< ambient light value
+    vec3f   ambient = {0.2,0.2,0.2}; ///< ambient light value
     vector<vec3f> cameralights_dir = { {1,-1,-1}, {-1,-1,-1}, {-1,1,0} }; ///< camera light directions
     vector<vec3f> cameralights_col = { {1,1,1}, {0.5,0.5,0.5}, {0.25,0.25,0.25} }; ///< camera light colors
     
@@ -29,11 +29,41 @@ struct DrawOptions : Node {
     bool control = true; ///< whether to draw shape control points
     bool control_no_depth = false; ///< whether to darw control without depth testing
     bool gizmos = true; ///< whether to draw gizmos
+
+    bool cull = true; ///< whether to skip primitives outside the view frustum
+    float cull_pixels = 1; ///< skip primitives whose projected bounds are smaller than this many pixels (0 to draw all)
+    float lod_pixels = 0; ///< draw tesselated shapes at the coarsest level with edges of about this many pixels on screen (0 for full detail)
+};
+
+/// Primitive counts of the last draw_scene
+struct DrawStats {
+    int drawn = 0; ///< primitives drawn
+    int culled_frustum = 0; ///< primitives skipped since outside the view frustum
+    int culled_small = 0; ///< primitives skipped since too small on screen
+};
+
+/// Vertex data of a mesh copied to gpu buffers when first drawn: static meshes are uploaded once, while meshes
+/// marked by shape_changed upload again only their positions and normals (all of it if the counts changed);
+/// meshes without normals are flat shaded, so their vertices are copied per face corner
+struct ShapeDrawBuffers {
+    unsigned int    vertex = 0; ///< vertex buffer: positions, then normals, then texcoords
+    unsigned int    index = 0; ///< index buffer: triangles, then quads (unused for per corner vertices, drawn in order)
+    int             changes = 0; ///< shape changes when last uploaded
+    int             nvertices = 0; ///< vertices
+    int             ntriangles = 0; ///< triangles
+    int             nquads = 0; ///< quads
+    bool            corners = false; ///< whether vertices are per face corner (flat shading or no texcoords)
+
+    /// Destructor (releases the buffers, so it needs the OpenGL context)
+    ~ShapeDrawBuffers();
 };
 
 ///@name interactive draw interface
 ///@{
-void draw_scene(Scene* scene, const DrawOptions& opts, bool clear);
+/// draw the scene primitives, skipping the ones culled by opts (whole subtrees of the scene acceleration structure
+/// if built, each cached primitive bounds otherwise) and drawing tesselated shapes at the level of detail for their
+/// size on screen (levels not built yet are drawn with the closest finer one); sets the primitive counts in stats if not null
+void draw_scene(Scene* scene, const DrawOptions& opts, bool clear, DrawStats* stats = nullptr);
 void draw_scene_decorations(Scene* scene, const DrawOptions& opts, bool clear);
 
 void draw_shape(Shape* shape);
@@ -1,6 +1,8 @@
 #include "gl_utils.h"
 #include "gls.h"
 
+#include "common/parallel.h"
+
 ///@file igl/gl_utils.cpp Opengl Utilities. @ingroup igl
 
 image3f glutils_read_pixels(int x, int y, int w, int h, bool front) {
@@ -184,6 +186,69 @@ void glutils_draw_sphere_lines(const vec3f& o, float r, int ul, int vl, int ur,
                          [o,r](const vec2f& uv) { return vec3f(sin(pif*uv.y)*cos(2*pif*uv.x),sin(pif*uv.y)*sin(2*pif*uv.x),cos(pif*uv.y)); });
     glsCheckError();
 }
+/// unit sphere point at parameter uv (the glutils_draw_sphere parametrization)
+inline vec3f _glutils_sphere_point(const vec2f& uv) {
+    return vec3f(sin(pif*uv.y)*cos(2*pif*uv.x),sin(pif*uv.y)*sin(2*pif*uv.x),cos(pif*uv.y));
+}
+
+/// vertex arrays of glutils_draw_spheres, kept across calls so that streaming the spheres of each frame does not allocate
+struct _GLUtilsSpheres {
+    int             ur = 0; ///< template resolution
+    int             vr = 0; ///< template resolution
+    vector<vec3f>   unit; ///< template vertices on the unit sphere (shared at the poles and along the seam)
+    vector<vec4i>   quad; ///< template quads
+    int             nspheres = 0; ///< spheres with normals and indices filled in (these only depend on the template)
+    vector<vec3f>   pos; ///< vertex positions
+    vector<vec3f>   norm; ///< vertex normals
+    vector<vec2f>   texcoord; ///< vertex texture coordinates
+    vector<vec4i>   index; ///< quads
+};
+
+void glutils_draw_spheres(const vector<vec3f>& pos, const vector<float>& radius, const vector<vec2f>& texcoord, int ur, int vr) {
+    static _GLUtilsSpheres spheres;
+    if(pos.empty()) return;
+    glsCheckError();
+    
+    // same quads as glutils_draw_sphere, with the vertices it repeats merged
+    if(spheres.ur != ur or spheres.vr != vr) {
+        spheres = _GLUtilsSpheres();
+        spheres.ur = ur; spheres.vr = vr;
+        auto vid = [ur,vr](int i, int j) { return (j == 0) ? 0 : ((j == vr) ? 1 : 2 + (j-1)*ur + i%ur); };
+        spheres.unit.push_back(_glutils_sphere_point(vec2f(0,0)));
+        spheres.unit.push_back(_glutils_sphere_point(vec2f(0,1)));
+        for(int j = 1; j < vr; j ++) for(int i = 0; i < ur; i ++) spheres.unit.push_back(_glutils_sphere_point(vec2f(i / float(ur), j / float(vr))));
+        for(int i = 0; i < ur; i ++) for(int j = 0; j < vr; j ++) spheres.quad.push_back(vec4i(vid(i,j),vid(i,j+1),vid(i+1,j+1),vid(i+1,j)));
+    }
+    
+    auto n = (int)pos.size();
+    auto nv = (int)spheres.unit.size();
+    if(spheres.nspheres < n) {
+        spheres.norm.resize(n*nv);
+        for(int s = spheres.nspheres; s < n; s ++) {
+            for(int v = 0; v < nv; v ++) spheres.norm[s*nv+v] = spheres.unit[v];
+            for(auto q : spheres.quad) spheres.index.push_back(q + vec4i(s*nv,s*nv,s*nv,s*nv));
+        }
+        spheres.nspheres = n;
+    }
+    spheres.pos.resize(n*nv);
+    if(not texcoord.empty()) spheres.texcoord.resize(n*nv);
+    parallel_for(n, glutils_spheres_parallel_grain, [&](int start, int end) {
+        for(int s = start; s < end; s ++) {
+            for(int v = 0; v < nv; v ++) spheres.pos[s*nv+v] = pos[s]+radius[s]*spheres.unit[v];
+            if(not texcoord.empty()) for(int v = 0; v < nv; v ++) spheres.texcoord[s*nv+v] = texcoord[s];
+        }
+    });
+    
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    glEnableClientState(GL_VERTEX_ARRAY); glsVertexPointer(spheres.pos);
+    glEnableClientState(GL_NORMAL_ARRAY); glsNormalPointer(spheres.norm);
+    if(not texcoord.empty()) { glEnableClientState(GL_TEXTURE_COORD_ARRAY); glsTexCoordPointer(spheres.texcoord); }
+    else glsTexCoord(zero2f);
+    glDrawElements(GL_QUADS,n*spheres.quad.size()*4,GL_UNSIGNED_INT,&spheres.index[0].x);
+    glPopClientAttrib();
+    
+    glsCheckError();
+}
 void glutils_draw_cylinder(float r, float h, int ur, int vr) {
     glsCheckError();
     glutils_draw_parametric_face(ur, vr, false,
@@ -304,6 +369,7 @@ void glutils_set_light(int idx, const vec4f& pos, const vec4f& ka, const vec4f&
 
 void glutils_set_ambient_light(const vec4f& ka) {
     glsCheckError();
+    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, &ka.x);
     glsCheckError();
 }
 
@@ -15,6 +15,11 @@ image3f glutils_read_pixels(int x, int y, int w, int h, bool front);
 image3f glutils_read_pixels(int w, int h, bool front);
 ///@}
 
+///@name Draw parameters
+///@{
+const int glutils_spheres_parallel_grain = 1024; ///< spheres below which glutils_draw_spheres fills the vertex arrays on one thread
+///@}
+
 ///@name Draw Utilities
 ///@{
 void glutils_draw_line(const vec3f& a, const vec3f& b);
@@ -36,6 +41,9 @@ void glutils_draw_parametric_line(int ul, int vl, int ur, int vr,
 void glutils_draw_sphere(const vec3f& o, float r, int ur = 64, int vr = 32);
 void glutils_draw_sphere(const vec3f& o, float r, const vec2f& uv, int ur = 64, int vr = 32);
 void glutils_draw_sphere_lines(const vec3f& o, float r, int ul = 16, int vl = 8, int ur = 64, int vr = 32);
+/// draw spheres at pos with the given radius, each with a constant texcoord (zero if empty), like repeated calls to
+/// glutils_draw_sphere but with one draw call: the vertices of all spheres are streamed in a single vertex array
+void glutils_draw_spheres(const vector<vec3f>& pos, const vector<float>& radius, const vector<vec2f>& texcoord, int ur = 4, int vr = 4);
 void glutils_draw_cylinder(float r, float h, int ur = 64, int vr = 32) ;
 void glutils_draw_cylinder(float r, float h, const vec2f& uv0, const vec2f& uv1, int ur = 64, int vr = 32) ;
 void glutils_draw_cylinder_lines(float r, float h, int ul = 16, int vl = 8, int ur = 64, int vr = 32);
@@ -0,0 +1,50 @@
+#include "hashgrid.h"
+
+#include "common/parallel.h"
+
+#include <algorithm>
+
+///@file igl/hashgrid.cpp Spatial Hash Grid. @ingroup igl
+
+/// points below which the passes of a build are not split across threads
+const int _hashgrid_parallel_grain = 4096;
+
+void hashgrid_build(HashGrid* grid, const vector<vec3f>& pos, float cell_size) {
+    auto n = (int)pos.size();
+    grid->cell_size = cell_size;
+    // a power of two number of buckets, at least twice the points, so that few cells share a bucket
+    auto nbuckets = 1;
+    while(nbuckets < 2*n) nbuckets *= 2;
+    grid->bucket_start.assign(nbuckets+1, 0);
+    grid->points.resize(n);
+    grid->_point_cell.resize(n);
+    
+    // count the points per bucket
+    auto counts = grid->bucket_start.data() + 1;
+    parallel_for(n, _hashgrid_parallel_grain, [grid,&pos,counts](int start, int end) {
+        for(int i = start; i < end; i ++) {
+            grid->_point_cell[i] = hashgrid_cell(grid, pos[i]);
+            __atomic_fetch_add(&counts[hashgrid_bucket(grid, grid->_point_cell[i])], 1, __ATOMIC_RELAXED);
+        }
+    });
+    for(int b = 0; b < nbuckets; b ++) grid->bucket_start[b+1] += grid->bucket_start[b];
+    
+    // scatter the points in their bucket, then sort each bucket so that the order does not depend on the threads
+    auto next = vector<int>(grid->bucket_start.begin(), grid->bucket_start.end()-1);
+    auto next_data = next.data();
+    parallel_for(n, _hashgrid_parallel_grain, [grid,next_data](int start, int end) {
+        for(int i = start; i < end; i ++) grid->points[__atomic_fetch_add(&next_data[hashgrid_bucket(grid, grid->_point_cell[i])], 1, __ATOMIC_RELAXED)] = i;
+    });
+    parallel_for(nbuckets, _hashgrid_parallel_grain, [grid](int start, int end) {
+        for(int b = start; b < end; b ++) {
+            if(grid->bucket_start[b+1] - grid->bucket_start[b] > 1)
+                std::sort(grid->points.begin()+grid->bucket_start[b], grid->points.begin()+grid->bucket_start[b+1]);
+        }
+    });
+}
+
+void hashgrid_build(HashGrid* grid, const vector<vec3f>& pos, const vector<float>& radius) {
+    auto radius_max = 0.0f;
+    for(auto r : radius) radius_max = max(radius_max, r);
+    hashgrid_build(grid, pos, (radius_max > 0) ? 2*radius_max : 1);
+}
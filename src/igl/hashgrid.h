@@ -0,0 +1,65 @@
+#ifndef _HASHGRID_H_
+#define _HASHGRID_H_
+
+#include "vmath/vmath.h"
+#include "common/std.h"
+
+///@file igl/hashgrid.h Spatial Hash Grid. @ingroup igl
+///@defgroup hashgrid Spatial Hash Grid
+///@ingroup igl
+///@{
+
+/// Uniform grid over an unbounded space, with the cells hashed into a table of buckets;
+/// points are stored sorted by bucket, so that the points of a bucket are contiguous
+struct HashGrid {
+    float               cell_size = 1; ///< cell size
+    vector<int>         bucket_start; ///< first entry in points of each bucket (with one more entry for the end)
+    vector<int>         points; ///< point indices, sorted by bucket, then by index
+    vector<vec3i>       _point_cell; ///< cell of each point (to skip the points of other cells sharing a bucket)
+};
+
+///@name hashgrid interface
+///@{
+/// rebuild the grid over the points pos with the given cell size (a parallel counting sort of the points into buckets);
+/// queries are fastest with cells twice the query radius, since they then visit at most 8 cells
+void hashgrid_build(HashGrid* grid, const vector<vec3f>& pos, float cell_size);
+/// rebuild the grid over particles at pos with the given radius, with cells large enough to find all overlapping particles
+/// by querying at most one cell away (twice the largest radius)
+void hashgrid_build(HashGrid* grid, const vector<vec3f>& pos, const vector<float>& radius);
+///@}
+
+/// grid cell of a point
+inline vec3i hashgrid_cell(HashGrid* grid, const vec3f& p) {
+    return vec3i((int)floor(p.x/grid->cell_size), (int)floor(p.y/grid->cell_size), (int)floor(p.z/grid->cell_size));
+}
+
+/// hash table bucket of a grid cell
+inline int hashgrid_bucket(HashGrid* grid, const vec3i& cell) {
+    auto h = ((unsigned)cell.x * 73856093u) ^ ((unsigned)cell.y * 19349663u) ^ ((unsigned)cell.z * 83492791u);
+    return h & (grid->bucket_start.size() - 2);
+}
+
+/// call neighbor(j) for each point j of the grid built over pos closer than radius to p, in a deterministic order
+template<typename F>
+inline void hashgrid_neighbors(HashGrid* grid, const vector<vec3f>& pos, const vec3f& p, float radius, const F& neighbor) {
+    if(grid->points.empty()) return;
+    auto cmin = hashgrid_cell(grid, p - vec3f(radius,radius,radius));
+    auto cmax = hashgrid_cell(grid, p + vec3f(radius,radius,radius));
+    for(int k = cmin.z; k <= cmax.z; k ++) {
+        for(int j = cmin.y; j <= cmax.y; j ++) {
+            for(int i = cmin.x; i <= cmax.x; i ++) {
+                auto cell = vec3i(i,j,k);
+                auto bucket = hashgrid_bucket(grid, cell);
+                for(int e = grid->bucket_start[bucket]; e < grid->bucket_start[bucket+1]; e ++) {
+                    auto point = grid->points[e];
+                    if(not (grid->_point_cell[point] == cell)) continue;
+                    if(distSqr(pos[point], p) < radius*radius) neighbor(point);
+                }
+            }
+        }
+    }
+}
+
+///@}
+
+#endif
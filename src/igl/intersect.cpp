@@ -1,6 +1,7 @@
 #include "intersect.h"
 
 #include "scene.h"
+#include "bvh.h"
 
 ///@file igl/intersect.cpp Intersection. @ingroup igl
 
@@ -193,17 +194,26 @@ range3f intersect_facemesh_element_bounds(FaceMesh* mesh, int elementid) {
     return triangle_bounds(mesh->pos[mesh->vertex[f.x].x], mesh->pos[mesh->vertex[f.y].x], mesh->pos[mesh->vertex[f.z].x]);
 }
 
+/// whether the shape tree is built over nelements elements
+inline bool _shape_bvh_valid(Shape* shape, int nelements) {
+    return shape->_bvh and not shape->_bvh->nodes.empty() and shape->_bvh->elements.size() == nelements;
+}
+
 range3f intersect_shape_bounds(Shape* shape) {
     if(shape->_tesselation) return intersect_shape_bounds(shape->_tesselation);
     
+    // point and line sets take the root bounds of their tree when built (shape_bvh_refit keeps it up to date)
+    // instead of recomputing the bounds of all their elements
     if(is<PointSet>(shape)) {
         auto pointset = cast<PointSet>(shape);
+        if(_shape_bvh_valid(shape, pointset->pos.size())) return shape->_bvh->nodes[0].bbox;
         range3f bbox;
         for(int i = 0; i < pointset->pos.size(); i ++) bbox = runion(bbox,intersect_pointset_element_bounds(pointset, i));
         return bbox;
     }
     else if(is<LineSet>(shape)) {
         auto lines = cast<LineSet>(shape);
+        if(_shape_bvh_valid(shape, lines->line.size())) return shape->_bvh->nodes[0].bbox;
         range3f bbox;
         for(int i = 0; i < lines->line.size(); i ++) bbox = runion(bbox,intersect_lineset_element_bounds(lines, i));
         return bbox;
@@ -225,22 +235,154 @@ range3f intersect_shape_bounds(Shape* shape) {
 }
 
 
-bool _intersect_element_first(int nelements, const function<bool(int,const ray3f&,intersection3f&)>& intersect_element, const ray3f& ray, intersection3f& intersection) {
-    bool hit = false;
-    float mint = ray3f::rayinf;
+void shape_bvh_init(Shape* shape) {
+    if(shape->_tesselation) { shape_bvh_init(shape->_tesselation); return; }
+    if(shape->_bvh) return;
+    
+    if(is<PointSet>(shape)) {
+        auto pointset = cast<PointSet>(shape);
+        shape->_bvh = bvh_build(pointset->pos.size(), [pointset](int elementid){ return intersect_pointset_element_bounds(pointset,elementid); });
+    }
+    else if(is<LineSet>(shape)) {
+        auto lines = cast<LineSet>(shape);
+        shape->_bvh = bvh_build(lines->line.size(), [lines](int elementid){ return intersect_lineset_element_bounds(lines,elementid); });
+    }
+    else if(is<TriangleMesh>(shape)) {
+        auto mesh = cast<TriangleMesh>(shape);
+        shape->_bvh = bvh_build(mesh->triangle.size(), [mesh](int elementid){ return intersect_trianglemesh_element_bounds(mesh,elementid); });
+    }
+    else if(is<Mesh>(shape)) {
+        auto mesh = cast<Mesh>(shape);
+        shape->_bvh = bvh_build(mesh->triangle.size() + mesh->quad.size()*2, [mesh](int elementid){ return intersect_mesh_element_bounds(mesh,elementid); });
+    }
+    else if(is<FaceMesh>(shape)) {
+        // built over the single index copy, which has the same elements, and used with it by queries
+        auto mesh = facemesh_mesh(cast<FaceMesh>(shape));
+        shape->_bvh = bvh_build(mesh->triangle.size() + mesh->quad.size()*2, [mesh](int elementid){ return intersect_mesh_element_bounds(mesh,elementid); });
+    }
+    else { } // analytic shapes do not need acceleration
+}
+
+/// number of elements of the shape acceleration structure (-1 for shapes without one)
+inline int _shape_bvh_nelements(Shape* shape) {
+    if(is<PointSet>(shape)) return cast<PointSet>(shape)->pos.size();
+    else if(is<LineSet>(shape)) return cast<LineSet>(shape)->line.size();
+    else if(is<TriangleMesh>(shape)) return cast<TriangleMesh>(shape)->triangle.size();
+    else if(is<Mesh>(shape)) return cast<Mesh>(shape)->triangle.size() + cast<Mesh>(shape)->quad.size()*2;
+    else if(is<FaceMesh>(shape)) return cast<FaceMesh>(shape)->triangle.size() + cast<FaceMesh>(shape)->quad.size()*2;
+    else return -1;
+}
+
+void shape_bvh_refit(Shape* shape, float rebuild_threshold) {
+    if(shape->_tesselation) { shape_bvh_refit(shape->_tesselation, rebuild_threshold); return; }
+    if(not shape->_bvh) return;
+    
+    // elements are created and destroyed (ex: particles), so the tree is rebuilt when their count changes,
+    // since refitting it would reference elements out of range
+    if(shape->_bvh->elements.size() != _shape_bvh_nelements(shape)) { shape_bvh_clear(shape); shape_bvh_init(shape); return; }
+    
+    if(is<PointSet>(shape)) {
+        auto pointset = cast<PointSet>(shape);
+        bvh_refit(shape->_bvh, [pointset](int elementid){ return intersect_pointset_element_bounds(pointset,elementid); }, rebuild_threshold);
+    }
+    else if(is<LineSet>(shape)) {
+        auto lines = cast<LineSet>(shape);
+        bvh_refit(shape->_bvh, [lines](int elementid){ return intersect_lineset_element_bounds(lines,elementid); }, rebuild_threshold);
+    }
+    else if(is<TriangleMesh>(shape)) {
+        auto mesh = cast<TriangleMesh>(shape);
+        bvh_refit(shape->_bvh, [mesh](int elementid){ return intersect_trianglemesh_element_bounds(mesh,elementid); }, rebuild_threshold);
+    }
+    else if(is<Mesh>(shape)) {
+        auto mesh = cast<Mesh>(shape);
+        bvh_refit(shape->_bvh, [mesh](int elementid){ return intersect_mesh_element_bounds(mesh,elementid); }, rebuild_threshold);
+    }
+    else if(is<FaceMesh>(shape)) {
+        auto mesh = facemesh_mesh(cast<FaceMesh>(shape));
+        bvh_refit(shape->_bvh, [mesh](int elementid){ return intersect_mesh_element_bounds(mesh,elementid); }, rebuild_threshold);
+    }
+    else { }
+}
+
+void shape_bvh_clear(Shape* shape) {
+    if(shape->_tesselation) shape_bvh_clear(shape->_tesselation);
+    if(shape->_bvh) { delete shape->_bvh; shape->_bvh = nullptr; }
+}
+
+/// shape acceleration structure, built on first use and rebuilt if the number of elements changed
+inline BVH* _shape_bvh(Shape* shape, int nelements) {
+    if(shape->_bvh and shape->_bvh->elements.size() != nelements) { delete shape->_bvh; shape->_bvh = nullptr; }
+    if(not shape->_bvh) shape_bvh_init(shape);
+    return shape->_bvh;
+}
+
+bool _intersect_element_first(BVH* bvh, const function<bool(int,const ray3f&,intersection3f&)>& intersect_element, const ray3f& ray, intersection3f& intersection) {
     ray3f sray = ray;
-    for(int i = 0; i < nelements; i ++) {
+    return bvh_intersect(bvh, sray, false, [&](int elementid) -> bool {
         intersection3f sintersection;
-        if(intersect_element(i, sray, sintersection)) {
-            if(mint > sintersection.ray_t) {
-                hit = true;
-                mint = sintersection.ray_t;
-                sray.tmax = mint;
-                intersection = sintersection;
-            }
+        if(not intersect_element(elementid, sray, sintersection)) return false;
+        if(sintersection.ray_t > sray.tmax) return false;
+        sray.tmax = sintersection.ray_t;
+        intersection = sintersection;
+        return true;
+    });
+}
+
+bool _intersect_element_any(BVH* bvh, const function<bool(int,const ray3f&)>& intersect_element, const ray3f& ray) {
+    ray3f sray = ray;
+    return bvh_intersect(bvh, sray, true, [&](int elementid){ return intersect_element(elementid, sray); });
+}
+
+/// gather the leaf triangles in structure-of-arrays layout and intersect them with intersect_triangles8;
+/// returns the bitmask of the hit lanes or -1 if the leaf is too large (never the case for bvh_leaf_max <= 8)
+template<typename FF>
+inline int _intersect_triangles_leaf(BVH* bvh, const BVHNode& node, const vector<vec3f>& pos, const FF& triangle_face, const ray3f& ray, float* t) {
+    if(node.count > 8) return -1;
+    triangles8f triangles = {};
+    for(int l = 0; l < node.count; l ++) {
+        auto f = triangle_face(bvh->elements[node.start+l]);
+        for(int i = 0; i < 3; i ++) { triangles.v0[i][l] = pos[f.x][i]; triangles.v1[i][l] = pos[f.y][i]; triangles.v2[i][l] = pos[f.z][i]; }
+    }
+    float ba[8], bb[8];
+    return intersect_triangles8(ray, triangles, node.count, t, ba, bb);
+}
+
+/// as _intersect_element_first for triangle elements, testing the leaves with intersect_triangles8 and calling
+/// intersect_element only for the lanes that hit closer than the current hit (to fill the intersection record)
+template<typename FF, typename F>
+inline bool _intersect_triangles_first(BVH* bvh, const vector<vec3f>& pos, const FF& triangle_face, const F& intersect_element, const ray3f& ray, intersection3f& intersection) {
+    ray3f sray = ray;
+    return bvh_intersect_leaves(bvh, sray, false, [&](const BVHNode& node) -> bool {
+        float t[8];
+        auto mask = _intersect_triangles_leaf(bvh, node, pos, triangle_face, sray, t);
+        bool hit = false;
+        for(int l = 0; l < node.count; l ++) {
+            if(mask >= 0 and (not (mask & (1 << l)) or t[l] > sray.tmax)) continue;
+            intersection3f sintersection;
+            if(not intersect_element(bvh->elements[node.start+l], sray, sintersection)) continue;
+            if(sintersection.ray_t > sray.tmax) continue;
+            sray.tmax = sintersection.ray_t;
+            intersection = sintersection;
+            hit = true;
         }
-    }
-    return hit;
+        return hit;
+    });
+}
+
+/// as _intersect_element_any for triangle elements, testing the leaves with intersect_triangles8
+template<typename FF>
+inline bool _intersect_triangles_any(BVH* bvh, const vector<vec3f>& pos, const FF& triangle_face, const ray3f& ray) {
+    ray3f sray = ray;
+    return bvh_intersect_leaves(bvh, sray, true, [&](const BVHNode& node) -> bool {
+        float t[8];
+        auto mask = _intersect_triangles_leaf(bvh, node, pos, triangle_face, sray, t);
+        if(mask >= 0) return mask != 0;
+        for(int i = node.start; i < node.start + node.count; i ++) {
+            auto f = triangle_face(bvh->elements[i]);
+            if(intersect_triangle(sray, pos[f.x], pos[f.y], pos[f.z])) return true;
+        }
+        return false;
+    });
 }
 
 bool intersect_shape_first(Shape* shape, const ray3f& ray, intersection3f& intersection) {
@@ -248,33 +390,37 @@ bool intersect_shape_first(Shape* shape, const ray3f& ray, intersection3f& inter
     
     if(is<PointSet>(shape)) {
         auto pointset = cast<PointSet>(shape);
-        return _intersect_element_first(pointset->pos.size(),
+        return _intersect_element_first(_shape_bvh(pointset,pointset->pos.size()),
                                         [pointset](int elementid, const ray3f& ray, intersection3f& intersection){ return intersect_pointset_element_first(pointset,elementid,ray,intersection); },
                                         ray, intersection);
     }
     else if(is<LineSet>(shape)) {
         auto lines = cast<LineSet>(shape);
-        return _intersect_element_first(lines->pos.size(),
+        return _intersect_element_first(_shape_bvh(lines,lines->line.size()),
                                         [lines](int elementid, const ray3f& ray, intersection3f& intersection){ return intersect_lineset_element_first(lines,elementid,ray,intersection); },
                                         ray, intersection);
     }
     else if(is<TriangleMesh>(shape)) {
         auto mesh = cast<TriangleMesh>(shape);
-        return _intersect_element_first(mesh->triangle.size(),
+        return _intersect_triangles_first(_shape_bvh(mesh,mesh->triangle.size()), mesh->pos,
+                [mesh](int elementid){ return mesh->triangle[elementid]; },
                 [mesh](int elementid, const ray3f& ray, intersection3f& intersection){ return intersect_trianglemesh_element_first(mesh,elementid,ray,intersection); },
                 ray, intersection);
     }
     else if(is<Mesh>(shape)) {
         auto mesh = cast<Mesh>(shape);
-        return _intersect_element_first(mesh->triangle.size() + mesh->quad.size()*2,
-                                        [mesh](int elementid, const ray3f& ray, intersection3f& intersection){ return intersect_mesh_element_first(mesh,elementid,ray,intersection); },
-                                        ray, intersection);
+        return _intersect_triangles_first(_shape_bvh(mesh,mesh->triangle.size()+mesh->quad.size()*2), mesh->pos,
+                                          [mesh](int elementid){ return mesh_triangle_face(mesh,elementid); },
+                                          [mesh](int elementid, const ray3f& ray, intersection3f& intersection){ return intersect_mesh_element_first(mesh,elementid,ray,intersection); },
+                                          ray, intersection);
     }
     else if(is<FaceMesh>(shape)) {
-        auto mesh = cast<FaceMesh>(shape);
-        return _intersect_element_first(mesh->triangle.size() + mesh->quad.size()*2,
-                                        [mesh](int elementid, const ray3f& ray, intersection3f& intersection){ return intersect_facemesh_element_first(mesh,elementid,ray,intersection); },
-                                        ray, intersection);
+        auto bvh = _shape_bvh(shape,cast<FaceMesh>(shape)->triangle.size()+cast<FaceMesh>(shape)->quad.size()*2);
+        auto mesh = cast<FaceMesh>(shape)->_mesh;
+        return _intersect_triangles_first(bvh, mesh->pos,
+                                          [mesh](int elementid){ return mesh_triangle_face(mesh,elementid); },
+                                          [mesh](int elementid, const ray3f& ray, intersection3f& intersection){ return intersect_mesh_element_first(mesh,elementid,ray,intersection); },
+                                          ray, intersection);
     }
     else if(is<Sphere>(shape)) {
         auto sphere = cast<Sphere>(shape);
@@ -346,29 +492,32 @@ bool intersect_shape_any(Shape* shape, const ray3f& ray) {
     if(shape->_tesselation) return intersect_shape_any(shape->_tesselation, ray);
     
     if(is<PointSet>(shape)) {
-        for(int i = 0; i < cast<PointSet>(shape)->pos.size(); i ++)
-            if(intersect_pointset_element_any(cast<PointSet>(shape),i,ray)) return true;
-        return false;
+        auto pointset = cast<PointSet>(shape);
+        return _intersect_element_any(_shape_bvh(pointset,pointset->pos.size()),
+                                      [pointset](int elementid, const ray3f& ray){ return intersect_pointset_element_any(pointset,elementid,ray); },
+                                      ray);
     }
     else if(is<LineSet>(shape)) {
-        for(int i = 0; i < cast<LineSet>(shape)->line.size(); i ++)
-            if(intersect_lineset_element_any(cast<LineSet>(shape),i,ray)) return true;
-        return false;
+        auto lines = cast<LineSet>(shape);
+        return _intersect_element_any(_shape_bvh(lines,lines->line.size()),
+                                      [lines](int elementid, const ray3f& ray){ return intersect_lineset_element_any(lines,elementid,ray); },
+                                      ray);
     }
     else if(is<TriangleMesh>(shape)) {
-        for(int i = 0; i < cast<TriangleMesh>(shape)->triangle.size(); i ++)
-            if(intersect_trianglemesh_element_any(cast<TriangleMesh>(shape),i,ray)) return true;
-        return false;
+        auto mesh = cast<TriangleMesh>(shape);
+        return _intersect_triangles_any(_shape_bvh(mesh,mesh->triangle.size()), mesh->pos,
+                                        [mesh](int elementid){ return mesh->triangle[elementid]; }, ray);
     }
     else if(is<Mesh>(shape)) {
-        for(int i = 0; i < cast<Mesh>(shape)->triangle.size() + cast<Mesh>(shape)->quad.size()*2; i ++)
-            if(intersect_mesh_element_any(cast<Mesh>(shape),i,ray)) return true;
-        return false;
+        auto mesh = cast<Mesh>(shape);
+        return _intersect_triangles_any(_shape_bvh(mesh,mesh->triangle.size()+mesh->quad.size()*2), mesh->pos,
+                                        [mesh](int elementid){ return mesh_triangle_face(mesh,elementid); }, ray);
     }
     else if(is<FaceMesh>(shape)) {
-        for(int i = 0; i < cast<FaceMesh>(shape)->triangle.size() + cast<Mesh>(shape)->quad.size()*2; i ++)
-            if(intersect_facemesh_element_any(cast<FaceMesh>(shape),i,ray)) return true;
-        return false;
+        auto bvh = _shape_bvh(shape,cast<FaceMesh>(shape)->triangle.size()+cast<FaceMesh>(shape)->quad.size()*2);
+        auto mesh = cast<FaceMesh>(shape)->_mesh;
+        return _intersect_triangles_any(bvh, mesh->pos,
+                                        [mesh](int elementid){ return mesh_triangle_face(mesh,elementid); }, ray);
     }
     else if(is<Sphere>(shape)) return intersect_sphere(ray, cast<Sphere>(shape)->center, cast<Sphere>(shape)->radius);
     else if(is<Cylinder>(shape)) return intersect_cylinder(ray, cast<Cylinder>(shape)->radius, cast<Cylinder>(shape)->height);
@@ -377,20 +526,115 @@ bool intersect_shape_any(Shape* shape, const ray3f& ray) {
     else { not_implemented_error(); return false; }
 }
 
+/// closest point to pos over the triangles (given by their vertices) whose bounds overlap the sphere of radius maxdist at pos
+bool _intersect_element_closest(BVH* bvh, const function<void(int,vec3f&,vec3f&,vec3f&)>& element_triangle, const vec3f& pos, float maxdist, vec3f& closest, vec3f& norm) {
+    auto hit = false;
+    auto bbox = sphere_bounds(pos, maxdist);
+    bvh_overlap(bvh, bbox, [&](int elementid) {
+        vec3f v0, v1, v2;
+        element_triangle(elementid, v0, v1, v2);
+        auto c = closest_point_triangle(pos, v0, v1, v2);
+        auto d = length(c - pos);
+        if(d >= maxdist) return;
+        maxdist = d;
+        bbox = sphere_bounds(pos, maxdist);
+        closest = c;
+        norm = triangle_normal(v0, v1, v2);
+        hit = true;
+    });
+    return hit;
+}
+
+bool intersect_shape_closest(Shape* shape, const vec3f& pos, float maxdist, vec3f& closest, vec3f& norm) {
+    if(shape->_tesselation) return intersect_shape_closest(shape->_tesselation, pos, maxdist, closest, norm);
+    
+    if(is<TriangleMesh>(shape)) {
+        auto mesh = cast<TriangleMesh>(shape);
+        return _intersect_element_closest(_shape_bvh(mesh,mesh->triangle.size()),
+                                          [mesh](int elementid, vec3f& v0, vec3f& v1, vec3f& v2){ auto f = mesh->triangle[elementid]; v0 = mesh->pos[f.x]; v1 = mesh->pos[f.y]; v2 = mesh->pos[f.z]; },
+                                          pos, maxdist, closest, norm);
+    }
+    else if(is<Mesh>(shape)) {
+        auto mesh = cast<Mesh>(shape);
+        return _intersect_element_closest(_shape_bvh(mesh,mesh->triangle.size()+mesh->quad.size()*2),
+                                          [mesh](int elementid, vec3f& v0, vec3f& v1, vec3f& v2){ auto f = mesh_triangle_face(mesh,elementid); v0 = mesh->pos[f.x]; v1 = mesh->pos[f.y]; v2 = mesh->pos[f.z]; },
+                                          pos, maxdist, closest, norm);
+    }
+    else if(is<FaceMesh>(shape)) {
+        auto bvh = _shape_bvh(shape,cast<FaceMesh>(shape)->triangle.size()+cast<FaceMesh>(shape)->quad.size()*2);
+        auto mesh = cast<FaceMesh>(shape)->_mesh;
+        return _intersect_element_closest(bvh,
+                                          [mesh](int elementid, vec3f& v0, vec3f& v1, vec3f& v2){ auto f = mesh_triangle_face(mesh,elementid); v0 = mesh->pos[f.x]; v1 = mesh->pos[f.y]; v2 = mesh->pos[f.z]; },
+                                          pos, maxdist, closest, norm);
+    }
+    else if(is<Sphere>(shape)) {
+        auto sphere = cast<Sphere>(shape);
+        if(pos == sphere->center) return false;
+        norm = normalize(pos - sphere->center);
+        closest = sphere->center + norm * sphere->radius;
+    }
+    else if(is<Cylinder>(shape)) {
+        auto cylinder = cast<Cylinder>(shape);
+        auto r = length(vec2f(pos.x,pos.y));
+        if(r == 0) return false;
+        norm = vec3f(pos.x/r,pos.y/r,0);
+        closest = vec3f(norm.x*cylinder->radius,norm.y*cylinder->radius,clamp(pos.z,0.0f,cylinder->height));
+    }
+    else if(is<Quad>(shape)) {
+        auto quad = cast<Quad>(shape);
+        closest = vec3f(clamp(pos.x,-quad->width/2,quad->width/2),clamp(pos.y,-quad->height/2,quad->height/2),0);
+        norm = z3f;
+    }
+    else if(is<Triangle>(shape)) {
+        auto triangle = cast<Triangle>(shape);
+        closest = closest_point_triangle(pos, triangle->v0, triangle->v1, triangle->v2);
+        norm = triangle_normal(triangle->v0, triangle->v1, triangle->v2);
+    }
+    else { not_implemented_error(); return false; }
+    return length(closest - pos) < maxdist;
+}
+
+/// bounds of a transformed shape over a time interval, sampling the animation at nsamples+1 times;
+/// bounds are padded by half the largest corner displacement between samples to cover the motion in between
+range3f _transformed_motion_bounds(TransformedSurface* transformed, const range3f& shape_bbox, const range1f& interval, int nsamples) {
+    auto shape_corners = corners(shape_bbox);
+    auto prev_corners = shape_corners;
+    auto bbox = range3f();
+    auto pad = 0.0f;
+    for(int s = 0; s <= nsamples; s ++) {
+        auto m = transformed_matrix(transformed, interval.min + size(interval)*s/nsamples);
+        for(int c = 0; c < 8; c ++) {
+            auto p = transform_point(m, shape_corners[c]);
+            bbox = runion(bbox, p);
+            if(s) pad = max(pad, dist(p, prev_corners[c]));
+            prev_corners[c] = p;
+        }
+    }
+    return range3f(bbox.min - vec3f(pad,pad,pad)/2, bbox.max + vec3f(pad,pad,pad)/2);
+}
+
 range3f intersect_primitive_bounds(Primitive* prim) {
     auto bbox = range3f();
     if(is<Surface>(prim)) bbox = intersect_shape_bounds(cast<Surface>(prim)->shape);
     else if(is<TransformedSurface>(prim)) {
         auto transformed = cast<TransformedSurface>(prim);
-        error_if_not(not transformed_animated(transformed), "intersect does not support animation");
-        bbox = transform_bbox(transformed_matrix(transformed, 0), intersect_shape_bounds(transformed->shape));
+        if(transformed_animated(transformed)) bbox = _transformed_motion_bounds(transformed, intersect_shape_bounds(transformed->shape), transformed_animation_interval(transformed), intersect_motion_segments*intersect_motion_samples);
+        else bbox = transform_bbox(transformed_matrix(transformed, 0), intersect_shape_bounds(transformed->shape));
     }
     else if(is<SimulatedSurface>(prim)) bbox = intersect_shape_bounds(cast<SimulatedSurface>(prim)->_shape);
+    else if(is<InterpolatedSurface>(prim)) for(auto shape : cast<InterpolatedSurface>(prim)->shapes) bbox = runion(bbox,intersect_shape_bounds(shape));
     else if(is<SkinnedSurface>(prim)) bbox = intersect_shape_bounds(cast<SkinnedSurface>(prim)->_posed_cached);
     else not_implemented_error();
     return transform_bbox(prim->frame, bbox);
 }
 
+range3f intersect_primitive_bounds(Primitive* prim, const range1f& interval) {
+    if(not is<TransformedSurface>(prim)) return intersect_primitive_bounds(prim);
+    auto transformed = cast<TransformedSurface>(prim);
+    if(not transformed_animated(transformed)) return intersect_primitive_bounds(prim);
+    return transform_bbox(prim->frame, _transformed_motion_bounds(transformed, intersect_shape_bounds(transformed->shape), interval, intersect_motion_samples));
+}
+
 bool intersect_primitive_first(Primitive* prim, const ray3f& ray, intersection3f& intersection) {
     auto hit = false;
     auto rayl = transform_ray_inverse(prim->frame,ray);
@@ -432,7 +676,11 @@ bool intersect_primitive_first(Primitive* prim, const ray3f& ray, float time, in
     }
     else if(is<InterpolatedSurface>(prim)) {
         auto interpolated = cast<InterpolatedSurface>(prim);
-        return intersect_shape_first(interpolated->shapes[interpolated_shapeidx(interpolated, time)], rayl, intersection);
+        hit = intersect_shape_first(interpolated->shapes[interpolated_shapeidx(interpolated, time)], rayl, intersection);
+    }
+    else if(is<SkinnedSurface>(prim)) {
+        // intersected as last posed, so skinned_update_pose should be called at time before
+        hit = intersect_shape_first(cast<SkinnedSurface>(prim)->_posed_cached, rayl, intersection);
     }
     else not_implemented_error();
     if(hit) {
@@ -476,59 +724,247 @@ bool intersect_primitive_any(Primitive* prim, const ray3f& ray, float time) {
         auto interpolated = cast<InterpolatedSurface>(prim);
         return intersect_shape_any(interpolated->shapes[interpolated_shapeidx(interpolated, time)], rayl);
     }
+    else if(is<SkinnedSurface>(prim)) return intersect_shape_any(cast<SkinnedSurface>(prim)->_posed_cached, rayl);
     else { not_implemented_error(); return false; }
 }
 
+void primitive_bvh_init(Primitive* prim) {
+    if(is<Surface>(prim)) shape_bvh_init(cast<Surface>(prim)->shape);
+    else if(is<TransformedSurface>(prim)) shape_bvh_init(cast<TransformedSurface>(prim)->shape);
+    else if(is<SimulatedSurface>(prim)) { if(cast<SimulatedSurface>(prim)->_shape) shape_bvh_init(cast<SimulatedSurface>(prim)->_shape); }
+    else if(is<InterpolatedSurface>(prim)) for(auto shape : cast<InterpolatedSurface>(prim)->shapes) shape_bvh_init(shape);
+    else if(is<SkinnedSurface>(prim)) { if(cast<SkinnedSurface>(prim)->_posed_cached) shape_bvh_init(cast<SkinnedSurface>(prim)->_posed_cached); }
+    else not_implemented_error();
+}
+
+/// time interval covered by the i-th motion segment of the group
+inline range1f _primitives_bvh_motion_segment(PrimitiveGroup* group, int segment) {
+    auto interval = group->_bvh_motion_interval;
+    return range1f(interval.min + size(interval)*segment/intersect_motion_segments,
+                   interval.min + size(interval)*(segment+1)/intersect_motion_segments);
+}
+
+void primitives_bvh_init(PrimitiveGroup* group) {
+    // shapes first, so that the bounds of point and line sets come from the root of their trees
+    for(auto p : group->prims) primitive_bvh_init(p);
+    if(group->_bvh) return;
+    auto& bounds = intersect_primitives_element_bounds(group);
+    group->_bvh = bvh_build(group->prims.size(), [&bounds](int primid){ return bounds[primid]; });
+    
+    // animated groups also get one tree per time segment, bounding the motion in that segment only
+    group->_bvh_motion_interval = primitives_animation_interval(group);
+    if(not isvalid(group->_bvh_motion_interval) or size(group->_bvh_motion_interval) <= 0) return;
+    for(int segment = 0; segment < intersect_motion_segments; segment ++) {
+        auto interval = _primitives_bvh_motion_segment(group, segment);
+        group->_bvh_motion.push_back(bvh_build(group->prims.size(), [group,interval](int primid){ return intersect_primitive_bounds(group->prims[primid],interval); }));
+    }
+}
+
+void primitives_bvh_refit(PrimitiveGroup* group) {
+    if(group->_bounds.empty()) return;
+    if(group->_bounds.size() != group->prims.size()) { primitives_bvh_clear(group); return; }
+    for(int primid = 0; primid < group->prims.size(); primid ++) group->_bounds[primid] = intersect_primitive_bounds(group->prims[primid]);
+    if(not group->_bvh) return;
+    bvh_refit(group->_bvh, [group](int primid){ return group->_bounds[primid]; });
+    for(int segment = 0; segment < group->_bvh_motion.size(); segment ++) {
+        auto interval = _primitives_bvh_motion_segment(group, segment);
+        bvh_refit(group->_bvh_motion[segment], [group,interval](int primid){ return intersect_primitive_bounds(group->prims[primid],interval); });
+    }
+}
+
+void primitives_bvh_clear(PrimitiveGroup* group) {
+    group->_bounds.clear();
+    if(group->_bvh) { delete group->_bvh; group->_bvh = nullptr; }
+    for(auto bvh : group->_bvh_motion) delete bvh;
+    group->_bvh_motion.clear();
+}
+
+/// primitives acceleration structure, built on first use
+inline BVH* _primitives_bvh(PrimitiveGroup* group) {
+    if(not group->_bvh) primitives_bvh_init(group);
+    return group->_bvh;
+}
+
+/// primitives acceleration structure for the time segment containing time, built on first use
+inline BVH* _primitives_bvh(PrimitiveGroup* group, float time) {
+    if(not group->_bvh) primitives_bvh_init(group);
+    if(group->_bvh_motion.empty()) return group->_bvh;
+    auto interval = group->_bvh_motion_interval;
+    auto segment = clamp((int)(intersect_motion_segments*(time-interval.min)/size(interval)), 0, intersect_motion_segments-1);
+    return group->_bvh_motion[segment];
+}
+
+const vector<range3f>& intersect_primitives_element_bounds(PrimitiveGroup* group) {
+    if(group->_bounds.size() != group->prims.size()) {
+        group->_bounds.resize(group->prims.size());
+        for(int primid = 0; primid < group->prims.size(); primid ++) group->_bounds[primid] = intersect_primitive_bounds(group->prims[primid]);
+    }
+    return group->_bounds;
+}
+
 range3f intersect_primitives_bounds(PrimitiveGroup* group) {
+    if(group->_bvh and not group->_bvh->nodes.empty()) return group->_bvh->nodes[0].bbox;
     range3f bbox;
     for(auto p : group->prims) bbox = runion(bbox,intersect_primitive_bounds(p));
     return bbox;
 }
 
 bool intersect_primitives_first(PrimitiveGroup* group, const ray3f& ray, intersection3f& intersection) {
-    bool hit = false;
-    float mint = ray3f::rayinf;
     ray3f sray = ray;
-    for(auto p : group->prims) {
+    return bvh_intersect(_primitives_bvh(group), sray, false, [&](int primid) -> bool {
         intersection3f sintersection;
-        if(intersect_primitive_first(p, sray, sintersection)) {
-            if(mint > sintersection.ray_t) {
-                hit = true;
-                mint = sintersection.ray_t;
-                sray.tmax = mint;
-                intersection = sintersection;
-            }
-        }
-    }
-    return hit;
+        if(not intersect_primitive_first(group->prims[primid], sray, sintersection)) return false;
+        if(sintersection.ray_t > sray.tmax) return false;
+        sray.tmax = sintersection.ray_t;
+        intersection = sintersection;
+        return true;
+    });
 }
 
 bool intersect_primitives_any(PrimitiveGroup* group, const ray3f& ray) {
-    for(auto p : group->prims) if(intersect_primitive_any(p,ray)) return true;
-    return false;
+    ray3f sray = ray;
+    return bvh_intersect(_primitives_bvh(group), sray, true, [&](int primid){ return intersect_primitive_any(group->prims[primid], sray); });
 }
 
 bool intersect_primitives_first(PrimitiveGroup* group, const ray3f& ray, float time, intersection3f& intersection) {
-    bool hit = false;
-    float mint = ray3f::rayinf;
     ray3f sray = ray;
-    for(auto p : group->prims) {
+    return bvh_intersect(_primitives_bvh(group,time), sray, false, [&](int primid) -> bool {
         intersection3f sintersection;
-        if(intersect_primitive_first(p, sray, time, sintersection)) {
-            if(mint > sintersection.ray_t) {
-                hit = true;
-                mint = sintersection.ray_t;
-                sray.tmax = mint;
-                intersection = sintersection;
-            }
+        if(not intersect_primitive_first(group->prims[primid], sray, time, sintersection)) return false;
+        if(sintersection.ray_t > sray.tmax) return false;
+        sray.tmax = sintersection.ray_t;
+        intersection = sintersection;
+        return true;
+    });
+}
+
+bool intersect_primitives_any(PrimitiveGroup* group, const ray3f& ray, float time) {
+    ray3f sray = ray;
+    return bvh_intersect(_primitives_bvh(group,time), sray, true, [&](int primid){ return intersect_primitive_any(group->prims[primid], sray, time); });
+}
+
+/// intersect ray r of a packet with a shape element, shrinking its tmax and filling its intersection if it hit closer
+template<typename F>
+inline void _intersect_packet_ray(ray3f* rays, int r, intersection3f* intersections, bool* hits, BVHPacketStats* stats, const F& intersect) {
+    intersection3f sintersection;
+    if(stats) stats->ray_element_tests ++;
+    if(not intersect(rays[r], sintersection)) return;
+    if(sintersection.ray_t > rays[r].tmax) return;
+    rays[r].tmax = sintersection.ray_t;
+    intersections[r] = sintersection;
+    hits[r] = true;
+}
+
+/// intersect the rays in mask with the elements of a shape, traversing its acceleration structure as a packet
+template<typename F>
+inline void _intersect_element_first_packet(BVH* bvh, const F& intersect_element, ray3f* rays, int n, uint64_t mask, intersection3f* intersections, bool* hits, BVHPacketStats* stats) {
+    bvh_intersect_packet(bvh, rays, n, mask, [&](int elementid, uint64_t raymask) {
+        for(auto m = raymask; m; m &= m-1) {
+            auto r = bvh_packet_lowest(m);
+            _intersect_packet_ray(rays, r, intersections, hits, stats, [&](const ray3f& ray, intersection3f& intersection){ return intersect_element(elementid,ray,intersection); });
+        }
+    }, stats);
+}
+
+/// intersect the rays in mask with a shape, shrinking their tmax and filling the intersections of the rays that hit closer
+void _intersect_shape_first_packet(Shape* shape, ray3f* rays, int n, uint64_t mask, intersection3f* intersections, bool* hits, BVHPacketStats* stats) {
+    if(shape->_tesselation) { _intersect_shape_first_packet(shape->_tesselation, rays, n, mask, intersections, hits, stats); return; }
+    
+    if(is<PointSet>(shape)) {
+        auto pointset = cast<PointSet>(shape);
+        _intersect_element_first_packet(_shape_bvh(pointset,pointset->pos.size()),
+                                        [pointset](int elementid, const ray3f& ray, intersection3f& intersection){ return intersect_pointset_element_first(pointset,elementid,ray,intersection); },
+                                        rays, n, mask, intersections, hits, stats);
+    }
+    else if(is<LineSet>(shape)) {
+        auto lines = cast<LineSet>(shape);
+        _intersect_element_first_packet(_shape_bvh(lines,lines->line.size()),
+                                        [lines](int elementid, const ray3f& ray, intersection3f& intersection){ return intersect_lineset_element_first(lines,elementid,ray,intersection); },
+                                        rays, n, mask, intersections, hits, stats);
+    }
+    else if(is<TriangleMesh>(shape)) {
+        auto mesh = cast<TriangleMesh>(shape);
+        _intersect_element_first_packet(_shape_bvh(mesh,mesh->triangle.size()),
+                                        [mesh](int elementid, const ray3f& ray, intersection3f& intersection){ return intersect_trianglemesh_element_first(mesh,elementid,ray,intersection); },
+                                        rays, n, mask, intersections, hits, stats);
+    }
+    else if(is<Mesh>(shape)) {
+        auto mesh = cast<Mesh>(shape);
+        _intersect_element_first_packet(_shape_bvh(mesh,mesh->triangle.size()+mesh->quad.size()*2),
+                                        [mesh](int elementid, const ray3f& ray, intersection3f& intersection){ return intersect_mesh_element_first(mesh,elementid,ray,intersection); },
+                                        rays, n, mask, intersections, hits, stats);
+    }
+    else if(is<FaceMesh>(shape)) {
+        auto bvh = _shape_bvh(shape,cast<FaceMesh>(shape)->triangle.size()+cast<FaceMesh>(shape)->quad.size()*2);
+        auto mesh = cast<FaceMesh>(shape)->_mesh;
+        _intersect_element_first_packet(bvh,
+                                        [mesh](int elementid, const ray3f& ray, intersection3f& intersection){ return intersect_mesh_element_first(mesh,elementid,ray,intersection); },
+                                        rays, n, mask, intersections, hits, stats);
+    }
+    else {
+        // analytic shapes have a single element
+        for(auto m = mask; m; m &= m-1) {
+            auto r = bvh_packet_lowest(m);
+            _intersect_packet_ray(rays, r, intersections, hits, stats, [shape](const ray3f& ray, intersection3f& intersection){ return intersect_shape_first(shape,ray,intersection); });
         }
     }
-    return hit;
 }
 
-bool intersect_primitives_any(PrimitiveGroup* group, const ray3f& ray, float time) {
-    for(auto p : group->prims) if(intersect_primitive_any(p,ray,time)) return true;
-    return false;
+/// intersect the rays in mask with a primitive, shrinking their tmax and filling the intersections of the rays that hit closer
+void _intersect_primitive_first_packet(Primitive* prim, ray3f* rays, int n, uint64_t mask, intersection3f* intersections, bool* hits, BVHPacketStats* stats) {
+    // shape and local transform, as in intersect_primitive_first
+    Shape* shape = nullptr;
+    TransformedSurface* transformed = nullptr;
+    if(is<Surface>(prim)) shape = cast<Surface>(prim)->shape;
+    else if(is<TransformedSurface>(prim)) {
+        transformed = cast<TransformedSurface>(prim);
+        error_if_not(not transformed_animated(transformed), "intersect does not support animation");
+        shape = transformed->shape;
+    }
+    else if(is<SimulatedSurface>(prim)) shape = cast<SimulatedSurface>(prim)->_shape;
+    else if(is<InterpolatedSurface>(prim)) {
+        error_if_not(not interpolated_animated(cast<InterpolatedSurface>(prim)), "intersect does not support animation");
+        shape = cast<InterpolatedSurface>(prim)->shapes[0];
+    }
+    else if(is<SkinnedSurface>(prim)) {
+        error_if_not(not skinned_animated(cast<SkinnedSurface>(prim)), "intersect does not support animation");
+        shape = cast<SkinnedSurface>(prim)->_posed_cached;
+    }
+    else not_implemented_error();
+    
+    auto m = (transformed) ? transformed_matrix(transformed,0) : identity_mat4f;
+    auto mi = (transformed) ? transformed_matrix_inv(transformed,0) : identity_mat4f;
+    ray3f local_rays[bvh_packet_size]; intersection3f local_intersections[bvh_packet_size]; bool local_hits[bvh_packet_size];
+    for(int r = 0; r < n; r ++) {
+        local_hits[r] = false;
+        if(not (mask & (uint64_t(1) << r))) continue;
+        local_rays[r] = transform_ray_inverse(prim->frame,rays[r]);
+        if(transformed) local_rays[r] = transform_ray(mi,local_rays[r]);
+    }
+    _intersect_shape_first_packet(shape, local_rays, n, mask, local_intersections, local_hits, stats);
+    for(int r = 0; r < n; r ++) {
+        if(not local_hits[r]) continue;
+        auto intersection = local_intersections[r];
+        if(transformed) intersection = transform_intersection(m,mi,intersection);
+        intersections[r] = transform_intersection(prim->frame,intersection);
+        intersections[r].material = prim->material;
+        rays[r].tmax = local_rays[r].tmax;
+        hits[r] = true;
+    }
+}
+
+void intersect_scene_first_packet(Scene* scene, const ray3f* rays, int n, intersection3f* intersections, bool* hits, BVHPacketStats* stats) {
+    auto group = scene->prims;
+    for(int start = 0; start < n; start += bvh_packet_size) {
+        auto count = min(bvh_packet_size, n - start);
+        auto mask = (count == 64) ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+        ray3f packet[bvh_packet_size];
+        for(int r = 0; r < count; r ++) { packet[r] = rays[start+r]; hits[start+r] = false; }
+        bvh_intersect_packet(_primitives_bvh(group), packet, count, mask, [&](int primid, uint64_t raymask) {
+            _intersect_primitive_first_packet(group->prims[primid], packet, count, raymask, intersections+start, hits+start, stats);
+        }, stats);
+        if(stats) { stats->packets ++; stats->rays += count; }
+    }
 }
 
 range3f intersect_scene_bounds(Scene* scene) { return intersect_primitives_bounds(scene->prims); }
@@ -539,3 +975,7 @@ bool intersect_scene_any(Scene* scene, const ray3f& ray) { return intersect_prim
 bool intersect_scene_first(Scene* scene, const ray3f& ray, float time, intersection3f& intersection) { return intersect_primitives_first(scene->prims, ray, time, intersection); }
 bool intersect_scene_any(Scene* scene, const ray3f& ray, float time) { return intersect_primitives_any(scene->prims, ray, time); }
 
+void scene_bvh_init(Scene* scene) { primitives_bvh_init(scene->prims); }
+void scene_bvh_refit(Scene* scene) { primitives_bvh_refit(scene->prims); }
+void scene_bvh_clear(Scene* scene) { primitives_bvh_clear(scene->prims); }
+
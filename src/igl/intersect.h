@@ -3,6 +3,7 @@
 
 #include "vmath/vmath.h"
 #include "common/std.h"
+#include "bvh.h"
 
 ///@file igl/intersect.h Intersection. @ingroup igl
 ///@defgroup intersect Intersection
@@ -12,6 +13,8 @@
 struct Material;
 struct Scene;
 struct Shape;
+struct Primitive;
+struct PrimitiveGroup;
 
 /// intersection record
 struct intersection3f {
@@ -46,12 +49,61 @@ range3f intersect_scene_bounds(Scene* scene);
 bool intersect_scene_first(Scene* scene, const ray3f& ray, intersection3f& intersection);
 bool intersect_scene_any(Scene* scene, const ray3f& ray);
 
+range3f intersect_shape_bounds(Shape* shape);
+/// world bounds of each primitive of the group (the whole animation for animated ones), computed on first use
+/// and kept until the group acceleration structure is refit or cleared (not thread safe)
+const vector<range3f>& intersect_primitives_element_bounds(PrimitiveGroup* group);
 bool intersect_shape_first(Shape* shape, const ray3f& ray, intersection3f& intersection);
+/// closest point of the shape surface to pos, if closer than maxdist, and the surface geometric normal there (in the shape frame);
+/// mesh elements are found with the shape acceleration structure (supports surfaces, not point or line sets)
+bool intersect_shape_closest(Shape* shape, const vec3f& pos, float maxdist, vec3f& closest, vec3f& norm);
 
 bool intersect_scene_first(Scene* scene, const ray3f& ray, float time, intersection3f& intersection);
 bool intersect_scene_any(Scene* scene, const ray3f& ray, float time);
 ///@}
 
+///@name packet intersection interface
+///@{
+/// intersect n rays at once, tracing them in packets of up to bvh_packet_size rays that traverse the acceleration
+/// structures together (faster for coherent rays, like camera rays of a tile); sets hits[i] and, if hit,
+/// intersections[i] for each ray, accumulating traversal statistics in stats if not null
+void intersect_scene_first_packet(Scene* scene, const ray3f* rays, int n, intersection3f* intersections, bool* hits, BVHPacketStats* stats = nullptr);
+///@}
+
+///@name acceleration parameters
+///@{
+const int intersect_motion_segments = 16; ///< number of time segments with their own acceleration structure for animated scenes
+const int intersect_motion_samples = 8; ///< animation samples per segment used to bound primitive motion
+///@}
+
+///@name acceleration interface
+///@{
+/// build the shape acceleration structure now (otherwise built on first intersection; not thread safe)
+void shape_bvh_init(Shape* shape);
+/// update the shape acceleration structure after its vertices moved (topology must be unchanged, except for point sets);
+/// the tree is rebuilt if refitting made it rebuild_threshold times more expensive (0 to never rebuild)
+void shape_bvh_refit(Shape* shape, float rebuild_threshold = 2);
+/// release the shape acceleration structure (call after editing the shape elements)
+void shape_bvh_clear(Shape* shape);
+
+/// build the acceleration structures of the primitive shapes now
+void primitive_bvh_init(Primitive* prim);
+
+/// build the primitive shapes and the group acceleration structures now (use before intersecting from multiple threads)
+void primitives_bvh_init(PrimitiveGroup* group);
+/// update the group acceleration structure and cached primitive bounds, without rebuilding it (call after editing primitive frames)
+void primitives_bvh_refit(PrimitiveGroup* group);
+/// release the group acceleration structure (call after adding or removing primitives)
+void primitives_bvh_clear(PrimitiveGroup* group);
+
+/// build all the scene acceleration structures now
+void scene_bvh_init(Scene* scene);
+/// update the scene acceleration structure after primitive frames changed
+void scene_bvh_refit(Scene* scene);
+/// release the scene acceleration structure
+void scene_bvh_clear(Scene* scene);
+///@}
+
 ///@}
 
 #endif
@@ -1,4 +1,6 @@
 #include "primitive.h"
+#include "intersect.h"
+#include "common/parallel.h"
 
 ///@file igl/primitive.cpp Primitives. @ingroup igl
 
@@ -198,6 +200,10 @@ void skinned_update_pose(SkinnedSurface* skinned, float time) {
         // Set the pose position
         pose_pos[i] = acc;
     }
+    
+    // Update the intersection acceleration structure, if any, and the draw buffers
+    shape_changed(skinned->_posed_cached);
+    shape_bvh_refit(skinned->_posed_cached);
 }
 
 range1f primitive_animation_interval(Primitive* prim) {
@@ -213,46 +219,75 @@ void primitive_simulation_init(Primitive* prim) {
         
         // Clear the particles
         simulated->_simulator = new ParticleSimulator();
+        simulated->_simulator->steps_per_sec = simulated->simulation_fps;
+        simulated->_simulator->implicit = simulated->simulation_implicit;
+        simulated->_simulator->adaptive = simulated->simulation_adaptive;
+        simulated->_simulator->collision_dumping = simulated->simulation_dumping;
+        simulated->_simulator->collision_friction = simulated->collision_friction;
+        
+        // Setup colliders, in the simulated surface frame where particles live
+        for(auto collider : simulated->colliders) {
+            error_if_not(is<Surface>(collider), "only Surface colliders are supported");
+            auto surface = cast<Surface>(collider);
+            auto particle_collider = ParticleCollider();
+            particle_collider.shape = surface->shape;
+            particle_collider.frame = transform_frame_inverse(simulated->frame, surface->frame);
+            simulated->_simulator->colliders.push_back(particle_collider);
+        }
+        simulator_colliders_init(simulated->_simulator);
         
         // Setup forces
-        simulated->_simulator->force = [simulated](const Particle& p) -> vec3f {
-            vec3f force = zero3f;
-            // Compute the forces acting on the particle (ex: gravity, wind)
-            force = (simulated->force_wind - p.vel) * simulated->force_airfriction + simulated->force_gravity * p.mass;
-            return force;
-        };
+        simulated->_simulator->forces.gravity = simulated->force_gravity;
+        simulated->_simulator->forces.wind = simulated->force_wind;
+        simulated->_simulator->forces.airfriction = simulated->force_airfriction;
 
         if(is<ParticleSystem>(simulated)) {
             auto psys = cast<ParticleSystem>(prim);
+            // Preallocate the particles alive at once (at most a lifetime, plus one update of up to a second, of births),
+            // so that steady emission does not allocate
+            auto capacity = (int)ceil(psys->particles_per_sec.max * (psys->particles_init_timer.max + 1));
+            psys->_simulator->particles.reserve(capacity);
+            psys->_points->pos.reserve(capacity);
+            psys->_points->radius.reserve(capacity);
+            // build the source sampling tables up front, since particles are created in parallel
+            shape_sample_init(psys->source_shape);
             psys->_simulator->begin_update = [psys](float dt){
-                int n = round(dt*psys->_rng.next_int(psys->particles_per_sec));     // number of particles to create
-                int i;
+                // random numbers come from counter-based streams keyed by update and by particle, so that
+                // particles are created in parallel with the same values for any number of threads
+                auto count_rng = RngCounter(particles_rng_key_count, psys->_updates++);
+                int n = round(dt*count_rng.next_int(psys->particles_per_sec));     // number of particles to create
+                auto& particles = psys->_simulator->particles;
 
                 // Delete particles that need to be killed off (i.e., if their timer <= 0)
-                for(i = psys->_simulator->particles.size() - 1; i >= 0; i--) {
-                    if(psys->_simulator->particles[i].timer <= 0)
-                        psys->_simulator->particles.erase(psys->_simulator->particles.begin() + i);
-                }
+                particles.remove_expired();
 
                 // Create particles, with initial values that I came up with to
                 // roughly match the reference program
-                for(i = 0; i < n; i++) {
-                    Particle particle;
-                    auto point = shape_sample_uniform(psys->source_shape, psys->_rng.next_vec2f());
-                    particle.pos = point.frame.o;
-                    particle.norm = point.frame.z;
-                    particle.timer = psys->_rng.next_float(psys->particles_init_timer); // so that the time-to-live of the particle roughly matches the test
-                    particle.radius = psys->_rng.next_float(psys->particles_init_radius); // so that the size of the particle roughly matches the test
-                    psys->_simulator->particles.push_back(particle);
-                }
-            };
-            psys->_simulator->end_update = [psys](float dt){
-                psys->_points->pos.resize(psys->_simulator->particles.size());
-                psys->_points->radius.resize(psys->_simulator->particles.size());
-                for(int i = 0; i < psys->_simulator->particles.size(); i ++) {
-                    psys->_points->pos[i] = psys->_simulator->particles[i].pos;
-                    psys->_points->radius[i] = psys->_simulator->particles[i].radius;
-                }
+                int first = particles.spawn(n), emitted = psys->_emitted;
+                psys->_emitted += particles.size() - first;
+                // rebuild the source sampling tables here if the source changed, not from the parallel loop
+                shape_sample_init(psys->source_shape);
+                parallel_for(particles.size() - first, particles_emit_grain, [psys,first,emitted](int start, int end) {
+                    auto& particles = psys->_simulator->particles;
+                    // sample the source in batches, to look it up once per batch
+                    RngCounter rngs[particles_emit_batch]; vec2f uvs[particles_emit_batch]; ShapeSample points[particles_emit_batch];
+                    for(int batch = start; batch < end; batch += particles_emit_batch) {
+                        auto n = min(particles_emit_batch, end - batch);
+                        for(int b = 0; b < n; b ++) {
+                            rngs[b] = RngCounter(particles_rng_key_init, emitted + batch + b);
+                            uvs[b] = rngs[b].next_vec2f();
+                        }
+                        shape_sample_uniform(psys->source_shape, uvs, points, n);
+                        for(int b = 0; b < n; b ++) {
+                            Particle particle;
+                            particle.pos = points[b].frame.o;
+                            particle.norm = points[b].frame.z;
+                            particle.timer = rngs[b].next_float(psys->particles_init_timer); // so that the time-to-live of the particle roughly matches the test
+                            particle.radius = rngs[b].next_float(psys->particles_init_radius); // so that the size of the particle roughly matches the test
+                            particles.set(first + batch + b, particle);
+                        }
+                    }
+                });
             };
         }
         else if(is<Cloth>(simulated)) {
@@ -261,17 +296,18 @@ void primitive_simulation_init(Primitive* prim) {
             // synch particles
             cloth->_simulator->particles.resize(cloth->_mesh->pos.size());
             for(int i = 0; i < cloth->_simulator->particles.size(); i ++) {
-                cloth->_simulator->particles[i] = Particle();
-                cloth->_simulator->particles[i].pos = cloth->_mesh->pos[i];
-                cloth->_simulator->particles[i].norm = cloth->_mesh->norm[i];
-                cloth->_simulator->particles[i].vel = zero3f;
-                cloth->_simulator->particles[i].radius = (cloth->source_size.x/cloth->source_grid.x+cloth->source_size.y/cloth->source_grid.y)/2;
-                cloth->_simulator->particles[i].mass = cloth->cloth_density/(cloth->_simulator->particles[i].radius*cloth->_simulator->particles[i].radius);
-                cloth->_simulator->particles[i].oriented = true;
-                cloth->_simulator->particles[i].pinned = false;
-                cloth->_simulator->particles[i].timer = 0;
+                auto particle = Particle();
+                particle.pos = cloth->_mesh->pos[i];
+                particle.norm = cloth->_mesh->norm[i];
+                particle.vel = zero3f;
+                particle.radius = (cloth->source_size.x/cloth->source_grid.x+cloth->source_size.y/cloth->source_grid.y)/2;
+                particle.mass = cloth->cloth_density/(particle.radius*particle.radius);
+                particle.oriented = true;
+                particle.pinned = false;
+                particle.timer = 0;
+                cloth->_simulator->particles.set(i, particle);
             }
-            for(auto p : cloth->pinned) cloth->_simulator->particles[p].pinned = true;
+            for(auto p : cloth->pinned) cloth->_simulator->particles.pinned[p] = true;
             
             // setup constraints
             for(int j = 0; j < cloth->source_grid.y; j ++) {
@@ -280,36 +316,56 @@ void primitive_simulation_init(Primitive* prim) {
                     int idx1 = (j+0)*(cloth->source_grid.x+1)+(i+1);
                     int idx2 = (j+1)*(cloth->source_grid.x+1)+(i+1);
                     int idx3 = (j+1)*(cloth->source_grid.x+1)+(i+0);
-                    cloth->_simulator->springs.push_back(ParticleSpring { cloth->cloth_stretch, cloth->cloth_dump, dist(cloth->_simulator->particles[idx0].pos,cloth->_simulator->particles[idx1].pos), idx0, idx1 });
-                    cloth->_simulator->springs.push_back(ParticleSpring { cloth->cloth_stretch, cloth->cloth_dump, dist(cloth->_simulator->particles[idx0].pos,cloth->_simulator->particles[idx3].pos), idx0, idx3 });
-                    cloth->_simulator->springs.push_back(ParticleSpring { cloth->cloth_shear, cloth->cloth_dump, dist(cloth->_simulator->particles[idx0].pos,cloth->_simulator->particles[idx2].pos), idx0, idx2 });
-                    cloth->_simulator->springs.push_back(ParticleSpring { cloth->cloth_shear, cloth->cloth_dump, dist(cloth->_simulator->particles[idx1].pos,cloth->_simulator->particles[idx3].pos), idx1, idx3 });
+                    cloth->_simulator->springs.push_back(ParticleSpring { cloth->cloth_stretch, cloth->cloth_dump, dist(cloth->_simulator->particles.pos[idx0],cloth->_simulator->particles.pos[idx1]), idx0, idx1 });
+                    cloth->_simulator->springs.push_back(ParticleSpring { cloth->cloth_stretch, cloth->cloth_dump, dist(cloth->_simulator->particles.pos[idx0],cloth->_simulator->particles.pos[idx3]), idx0, idx3 });
+                    cloth->_simulator->springs.push_back(ParticleSpring { cloth->cloth_shear, cloth->cloth_dump, dist(cloth->_simulator->particles.pos[idx0],cloth->_simulator->particles.pos[idx2]), idx0, idx2 });
+                    cloth->_simulator->springs.push_back(ParticleSpring { cloth->cloth_shear, cloth->cloth_dump, dist(cloth->_simulator->particles.pos[idx1],cloth->_simulator->particles.pos[idx3]), idx1, idx3 });
                     if(j+2 <= cloth->source_grid.y) {
                         int idx3p = (j+2)*(cloth->source_grid.x+1)+(i+0);
-                        cloth->_simulator->springs.push_back(ParticleSpring { cloth->cloth_bend, cloth->cloth_dump, dist(cloth->_simulator->particles[idx0].pos,cloth->_simulator->particles[idx3p].pos), idx0, idx3p });
+                        cloth->_simulator->springs.push_back(ParticleSpring { cloth->cloth_bend, cloth->cloth_dump, dist(cloth->_simulator->particles.pos[idx0],cloth->_simulator->particles.pos[idx3p]), idx0, idx3p });
                     }
                     if(i+2 <= cloth->source_grid.x) {
                         int idx1p = (j+0)*(cloth->source_grid.x+1)+(i+2);
-                        cloth->_simulator->springs.push_back(ParticleSpring { cloth->cloth_bend, cloth->cloth_dump, dist(cloth->_simulator->particles[idx0].pos,cloth->_simulator->particles[idx1p].pos), idx0, idx1p });
+                        cloth->_simulator->springs.push_back(ParticleSpring { cloth->cloth_bend, cloth->cloth_dump, dist(cloth->_simulator->particles.pos[idx0],cloth->_simulator->particles.pos[idx1p]), idx0, idx1p });
                     }
                 }
             }
-            
-            cloth->_simulator->end_step = [cloth](float dt){
-                for(int i = 0; i < cloth->_mesh->pos.size(); i ++) {
-                    cloth->_mesh->pos[i] = cloth->_simulator->particles[i].pos;
-                }
-                shape_smooth_frames(cloth->_mesh);
-                for(int i = 0; i < cloth->_mesh->pos.size(); i ++) {
-                    cloth->_simulator->particles[i].norm = cloth->_mesh->norm[i];
-                }
-            };
+            simulator_springs_init(cloth->_simulator);
+            if(cloth->cloth_selfcollision) cloth->_simulator->self_collision = (cloth->source_size.x/cloth->source_grid.x+cloth->source_size.y/cloth->source_grid.y)/2;
         }
         else not_implemented_error();
     }
     else return;
 }
 
+void primitive_simulation_sync(Primitive* prim) {
+    if(is<ParticleSystem>(prim)) {
+        auto psys = cast<ParticleSystem>(prim);
+        // bulk copy, since particles and points store positions and radia the same way
+        psys->_points->pos = psys->_simulator->particles.pos;
+        psys->_points->radius = psys->_simulator->particles.radius;
+    }
+    else if(is<Cloth>(prim)) {
+        auto cloth = cast<Cloth>(prim);
+        cloth->_mesh->pos = cloth->_simulator->particles.pos;
+        shape_smooth_frames(cloth->_mesh);
+    }
+    else return;
+    shape_changed(cast<SimulatedSurface>(prim)->_shape);
+    shape_bvh_refit(cast<SimulatedSurface>(prim)->_shape);
+}
+
 void primitive_simulation_update(Primitive* prim, float dt) {
-    if(is<SimulatedSurface>(prim)) simulator_update(cast<SimulatedSurface>(prim)->_simulator,dt);
+    if(is<SimulatedSurface>(prim)) {
+        auto simulated = cast<SimulatedSurface>(prim);
+        simulator_update(simulated->_simulator,dt);
+        primitive_simulation_sync(simulated);
+    }
+}
+
+void primitives_simulation_update(PrimitiveGroup* group, float dt) {
+    // simulated primitives only read the others (as colliders), so they are updated as concurrent tasks,
+    // each still splitting its own passes over the threads left idle
+    parallel_tasks(group->prims.size(), [group,dt](int p){ primitive_simulation_update(group->prims[p],dt); });
+    primitives_bvh_refit(group);
 }
@@ -22,6 +22,12 @@ struct Primitive : Node {
 /// Group of Primitives
 struct PrimitiveGroup : Node {
 	vector<Primitive*>       prims; ///< primitives
+
+	vector<range3f>          _bounds; ///< world bounds of each primitive (computed lazily, updated with the acceleration structure)
+	BVH*                     _bvh = nullptr; ///< intersection acceleration structure over prims (built lazily)
+	vector<BVH*>             _bvh_motion; ///< acceleration structures over consecutive time segments of the animation (built lazily)
+	range1f                  _bvh_motion_interval; ///< animation interval covered by _bvh_motion
+	vector<char>             _draw_culled; ///< culling state of each primitive in the last draw (reused across frames)
 };
 
 /// Basic Surface
@@ -83,6 +89,11 @@ struct SimulatedSurface : Primitive {
     
     float                   simulation_dumping = 0.5; ///< dumping coeffieicnt for simulation
     int                     simulation_fps = 1000; ///< simulation steps per second
+    bool                    simulation_implicit = false; ///< whether to use implicit integration (stable for stiff cloth at much lower simulation_fps)
+    bool                    simulation_adaptive = false; ///< whether to take as few steps as stable (simulation_fps is then the maximum)
+    
+    vector<Primitive*>      colliders; ///< surfaces the particles collide with (only Surface, which do not move during the simulation)
+    float                   collision_friction = 0.5; ///< friction coefficient of collisions (simulation_dumping sets their restitution)
     
     ParticleSimulator*      _simulator = nullptr; ///< simulator
     Shape*                  _shape = nullptr; ///< simulated shape
@@ -100,7 +111,8 @@ struct ParticleSystem : SimulatedSurface {
     range1f                 particles_init_density = range1f(1000,1000); ///< range of particle creation density
     
     PointSet*               _points = nullptr; ///< typed simulated shape
-    Rng                     _rng; ///< random number generator for particle creation
+    int                     _updates = 0; ///< updates so far (keys the random number of particles created at each update)
+    int                     _emitted = 0; ///< particles created so far (keys the random initial values of each particle)
 };
 
 struct Cloth : SimulatedSurface {
@@ -116,6 +128,8 @@ struct Cloth : SimulatedSurface {
     
     vector<int>             pinned; ///< indices of pinned vertices
     
+    bool                    cloth_selfcollision = false; ///< whether the cloth collides with itself (keeping its particles a grid spacing apart)
+    
     Mesh*                   _mesh = nullptr; ///< typed simulated shape
 };
 
@@ -170,6 +184,14 @@ inline range1f primitives_animation_interval(PrimitiveGroup* group) {
 }
 ///@}
 
+///@name particle system parameters
+///@{
+const uint32_t particles_rng_key_count = 1; ///< key of the random streams of the number of particles created at each update
+const uint32_t particles_rng_key_init = 2; ///< key of the random streams of the initial values of each particle
+const int particles_emit_grain = 256; ///< particles below which creation is not split across threads
+const int particles_emit_batch = 64; ///< particles whose source points are sampled at once
+///@}
+
 ///@name simulation interface
 ///@{
 inline bool primitive_simulation_has(Primitive* prim) {
@@ -185,9 +207,10 @@ inline void primitives_simulation_init(PrimitiveGroup* group) {
     for(auto p : group->prims) primitive_simulation_init(p);
 }
 void primitive_simulation_update(Primitive* prim, float dt);
-inline void primitives_simulation_update(PrimitiveGroup* group, float dt) {
-    for(auto p : group->prims) primitive_simulation_update(p,dt);
-}
+/// copy the simulated particles to the simulated shape, recomputing its normals (done once per update, not per step)
+void primitive_simulation_sync(Primitive* prim);
+/// update all simulated primitives concurrently (they only interact as colliders, which are not simulated)
+void primitives_simulation_update(PrimitiveGroup* group, float dt);
 ///@}
 
 ///@}
@@ -351,6 +351,10 @@ void serialize_members(Node* node, Serializer& ser) {
             ser.serialize_member("force_airfriction",simulated->force_airfriction);
             ser.serialize_member("simulation_fps",simulated->simulation_fps);
             ser.serialize_member("simulation_dumping",simulated->simulation_dumping);
+            ser.serialize_member("simulation_implicit",simulated->simulation_implicit);
+            ser.serialize_member("simulation_adaptive",simulated->simulation_adaptive);
+            ser.serialize_member("colliders",simulated->colliders);
+            ser.serialize_member("collision_friction",simulated->collision_friction);
             if(not simulated) error("node is null");
             else if(is<ParticleSystem>(node)) {
                 auto particles = cast<ParticleSystem>(node);
@@ -371,6 +375,7 @@ void serialize_members(Node* node, Serializer& ser) {
                 ser.serialize_member("cloth_dump",cloth->cloth_dump);
                 ser.serialize_member("cloth_density",cloth->cloth_density);
                 ser.serialize_member("pinned",cloth->pinned);
+                ser.serialize_member("cloth_selfcollision",cloth->cloth_selfcollision);
             }
             else not_implemented_error();
         }
@@ -456,6 +461,9 @@ void serialize_members(Node* node, Serializer& ser) {
         ser.serialize_member("control", opts->control);
         ser.serialize_member("control_no_depth", opts->control_no_depth);
         ser.serialize_member("gizmos", opts->gizmos);
+        ser.serialize_member("cull", opts->cull);
+        ser.serialize_member("cull_pixels", opts->cull_pixels);
+        ser.serialize_member("lod_pixels", opts->lod_pixels);
     }
     else not_implemented_error();
 }
@@ -0,0 +1,91 @@
+#include "shade.h"
+
+#include "common/parallel.h"
+
+#include <thread>
+#include <atomic>
+
+///@file igl/shade.cpp Headless Shading. @ingroup igl
+
+vec3f shade_intersection(const intersection3f& intersection, const vec3f& wo, LightGroup* lights, const DrawOptions& opts) {
+    auto frame = intersection.frame;
+    if(opts.doublesided and dot(frame.z,wo) < 0) frame.z = -frame.z;
+    auto material = intersection.material;
+    // same terms as the fixed pipeline setup in draw_material and draw_lights
+    auto c = opts.ambient * material_diffuse_albedo(material);
+    for(auto light : lights->lights) {
+        auto ss = light_shadow_sample(light, frame.o);
+        c += ss.radiance * material_brdfcos(material, frame, ss.dir, wo);
+    }
+    return c;
+}
+
+/// pose skinned surfaces at time and build the acceleration structures (lazy builds are not thread safe)
+void _shade_scene_prepare(Scene* scene, float time) {
+    for(auto prim : scene->prims->prims) {
+        if(is<SkinnedSurface>(prim)) skinned_update_pose(cast<SkinnedSurface>(prim), time);
+    }
+    scene_bvh_refit(scene);
+    scene_bvh_init(scene);
+}
+
+/// shade the pixels of tile (tx,ty); each sample of a tile is one ray packet, unless the scene is
+/// animated, in which case rays are traced one by one at opts.time
+void _shade_tile(Scene* scene, LightGroup* lights, const DrawOptions& opts, bool animated, int tx, int ty, image3f& img) {
+    auto ns = max(1,(int)round(sqrt((float)opts.samples)));
+    auto i0 = tx*shade_tile_size, i1 = min(i0+shade_tile_size, img.width());
+    auto j0 = ty*shade_tile_size, j1 = min(j0+shade_tile_size, img.height());
+
+    ray3f rays[bvh_packet_size];
+    intersection3f intersections[bvh_packet_size];
+    bool hits[bvh_packet_size];
+    vec3f colors[bvh_packet_size];
+    for(auto& c : colors) c = zero3f;
+
+    for(int s = 0; s < ns*ns; s ++) {
+        auto n = 0;
+        for(int j = j0; j < j1; j ++) {
+            for(int i = i0; i < i1; i ++) {
+                auto uv = vec2f((i+(s%ns+0.5f)/ns)/img.width(), (j+(s/ns+0.5f)/ns)/img.height());
+                rays[n++] = camera_ray(scene->camera, uv);
+            }
+        }
+        if(animated) { for(int r = 0; r < n; r ++) hits[r] = intersect_scene_first(scene, rays[r], opts.time, intersections[r]); }
+        else intersect_scene_first_packet(scene, rays, n, intersections, hits);
+        for(int r = 0; r < n; r ++) {
+            if(hits[r]) colors[r] += shade_intersection(intersections[r], -rays[r].d, lights, opts);
+            else colors[r] += opts.background;
+        }
+    }
+
+    auto r = 0;
+    for(int j = j0; j < j1; j ++) {
+        for(int i = i0; i < i1; i ++) img.at(i,j) = colors[r++] / (ns*ns);
+    }
+}
+
+image3f shade_scene(Scene* scene, const DrawOptions& opts, int nthreads) {
+    int w = camera_image_width(scene->camera,opts.res);
+    int h = camera_image_height(scene->camera,opts.res);
+
+    if(opts.cameralights) scene_cameralights_update(scene,opts.cameralights_dir,opts.cameralights_col);
+    auto lights = (opts.cameralights) ? scene->_cameralights : scene->lights;
+    _shade_scene_prepare(scene, opts.time);
+    auto animated = isvalid(scene_animation_interval(scene));
+
+    auto img = image3f(w,h);
+    auto ntiles_x = (w+shade_tile_size-1)/shade_tile_size;
+    auto ntiles = ntiles_x * ((h+shade_tile_size-1)/shade_tile_size);
+
+    // threads pull tiles from a shared counter, so that expensive tiles do not stall the others
+    if(nthreads <= 0) nthreads = parallel_nthreads();
+    std::atomic<int> tile_next(0);
+    auto worker = [&]() {
+        for(auto tile = tile_next++; tile < ntiles; tile = tile_next++)
+            _shade_tile(scene, lights, opts, animated, tile%ntiles_x, tile/ntiles_x, img);
+    };
+    auto threads = vector<std::thread>();
+    for(int t = 0; t < nthreads; t ++) threads.push_back(std::thread(worker));
+    for(auto& thread : threads) thread.join();
+    return img;
+}
@@ -0,0 +1,32 @@
+#ifndef _SHADE_H_
+#define _SHADE_H_
+
+#include "scene.h"
+#include "draw.h"
+#include "intersect.h"
+#include "image.h"
+
+///@file igl/shade.h Headless Shading. @ingroup igl
+///@defgroup shade Headless Shading
+///@ingroup igl
+///@{
+
+///@name shade parameters
+///@{
+const int shade_tile_size = 8; ///< image tile size (a tile sample is one bvh_packet_size ray packet)
+///@}
+
+///@name headless shade interface
+///@{
+/// shade the intersection seen from direction wo with ambient and direct lighting (no shadows, like draw_scene)
+vec3f shade_intersection(const intersection3f& intersection, const vec3f& wo, LightGroup* lights, const DrawOptions& opts);
+
+/// render the scene faces from its camera at opts.time without OpenGL, tracing opts.samples rays per pixel;
+/// tiles are shaded in parallel on nthreads threads (0 for the threads of parallel loops);
+/// rows are stored bottom to top, like glutils_read_pixels
+image3f shade_scene(Scene* scene, const DrawOptions& opts, int nthreads = 0);
+///@}
+
+///@}
+
+#endif
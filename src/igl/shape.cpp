@@ -1,7 +1,40 @@
 #include "shape.h"
 
+#include "bvh.h"
+#include "draw.h"
+#include "tesselate.h"
+
+#include <unordered_map>
+
 ///@file igl/shape.cpp Shapes. @ingroup igl
 
+Shape& Shape::operator=(const Shape& shape) {
+    Node::operator=(shape);
+    _tesselation = shape._tesselation;
+    if(_bvh) { delete _bvh; _bvh = nullptr; }
+    if(_area_table) { delete _area_table; _area_table = nullptr; }
+    if(_draw_buffers) { delete _draw_buffers; _draw_buffers = nullptr; }
+    if(_levels) { delete _levels; _levels = nullptr; }
+    return *this;
+}
+
+FaceMesh& FaceMesh::operator=(const FaceMesh& mesh) {
+    Shape::operator=(mesh);
+    pos = mesh.pos; norm = mesh.norm; texcoord = mesh.texcoord;
+    vertex = mesh.vertex; triangle = mesh.triangle; quad = mesh.quad;
+    _tesselation_lines = mesh._tesselation_lines;
+    if(_mesh) { delete _mesh; _mesh = nullptr; }
+    _mesh_vertex.clear();
+    return *this;
+}
+
+Shape::~Shape() {
+    if(_bvh) delete _bvh;
+    if(_area_table) delete _area_table;
+    if(_draw_buffers) delete _draw_buffers;
+    if(_levels) delete _levels;
+}
+
 Shape* shape_clone(Shape* shape) {
     if(is<Sphere>(shape)) return new Sphere(*cast<Sphere>(shape));
     else if(is<Cylinder>(shape)) return new Cylinder(*cast<Cylinder>(shape));
@@ -172,30 +205,210 @@ frame3f facemesh_frame(FaceMesh* mesh, int elementid, const vec2f& uv) {
     return ff;
 }
 
-ShapeSample shape_sample_uniform(Shape* shape, const vec2f& uv) {
+/// hash of the position, normal and texcoord indices of a face mesh vertex
+struct _FaceMeshVertexHash {
+    size_t operator()(const vec3i& v) const { return ((unsigned)v.x * 73856093u) ^ ((unsigned)v.y * 19349663u) ^ ((unsigned)v.z * 83492791u); }
+};
+
+Mesh* facemesh_mesh(FaceMesh* mesh) {
+    auto copy = mesh->_mesh;
+    auto rebuild = not copy or mesh->_mesh_nvertex != mesh->vertex.size() or
+                   copy->triangle.size() != mesh->triangle.size() or copy->quad.size() != mesh->quad.size() or
+                   copy->norm.empty() != mesh->norm.empty() or copy->texcoord.empty() != mesh->texcoord.empty();
+    if(not rebuild and mesh->_mesh_changes == mesh->_changes) return copy;
+    
+    if(rebuild) {
+        if(not copy) copy = mesh->_mesh = new Mesh();
+        // indices of missing attributes are ignored, so that more vertices are merged
+        auto index = vector<int>(mesh->vertex.size());
+        auto merged = std::unordered_map<vec3i,int,_FaceMeshVertexHash>();
+        mesh->_mesh_vertex.clear();
+        for(auto vid : range(mesh->vertex.size())) {
+            auto v = mesh->vertex[vid];
+            auto key = vec3i(v.x, (mesh->norm.empty()) ? 0 : v.y, (mesh->texcoord.empty()) ? 0 : v.z);
+            auto inserted = merged.insert(std::make_pair(key, (int)mesh->_mesh_vertex.size()));
+            if(inserted.second) mesh->_mesh_vertex.push_back(vid);
+            index[vid] = inserted.first->second;
+        }
+        mesh->_mesh_nvertex = mesh->vertex.size();
+        copy->triangle.resize(mesh->triangle.size());
+        for(auto i : range(mesh->triangle.size())) { auto f = mesh->triangle[i]; copy->triangle[i] = vec3i(index[f.x],index[f.y],index[f.z]); }
+        copy->quad.resize(mesh->quad.size());
+        for(auto i : range(mesh->quad.size())) { auto f = mesh->quad[i]; copy->quad[i] = vec4i(index[f.x],index[f.y],index[f.z],index[f.w]); }
+        copy->_tesselation_lines.resize(mesh->_tesselation_lines.size());
+        for(auto i : range(mesh->_tesselation_lines.size())) { auto l = mesh->_tesselation_lines[i]; copy->_tesselation_lines[i] = vec2i(index[l.x],index[l.y]); }
+        // the elements changed too, not only the vertex data
+        if(copy->_draw_buffers) { delete copy->_draw_buffers; copy->_draw_buffers = nullptr; }
+    }
+    
+    auto n = mesh->_mesh_vertex.size();
+    copy->pos.resize(n);
+    copy->norm.resize((mesh->norm.empty()) ? 0 : n);
+    copy->texcoord.resize((mesh->texcoord.empty()) ? 0 : n);
+    for(auto i : range(n)) {
+        auto v = mesh->vertex[mesh->_mesh_vertex[i]];
+        copy->pos[i] = mesh->pos[v.x];
+        if(not mesh->norm.empty()) copy->norm[i] = mesh->norm[v.y];
+        if(not mesh->texcoord.empty()) copy->texcoord[i] = mesh->texcoord[v.z];
+    }
+    mesh->_mesh_changes = mesh->_changes;
+    shape_changed(copy);
+    return copy;
+}
+
+/// build the alias table of n elements with the given areas
+template<typename F>
+ShapeAreaTable* _shape_area_table_build(int n, const F& element_area) {
+    auto table = new ShapeAreaTable();
+    table->prob.resize(n);
+    table->alias.resize(n);
+    auto scaled = vector<float>(n);
+    auto total = 0.0;
+    for(int i = 0; i < n; i ++) { scaled[i] = element_area(i); total += scaled[i]; }
+    error_if_not(n > 0 and total > 0, "cannot sample shapes without area");
+    table->area = total;
+    // split the elements in the ones below and above the average, then fill each low one with a high one
+    auto small = vector<int>(), large = vector<int>();
+    for(int i = 0; i < n; i ++) {
+        scaled[i] = scaled[i] * n / total;
+        if(scaled[i] < 1) small.push_back(i); else large.push_back(i);
+    }
+    while(not small.empty() and not large.empty()) {
+        auto s = small.back(); small.pop_back();
+        auto l = large.back(); large.pop_back();
+        table->prob[s] = scaled[s];
+        table->alias[s] = l;
+        scaled[l] = (scaled[l] + scaled[s]) - 1;
+        if(scaled[l] < 1) small.push_back(l); else large.push_back(l);
+    }
+    // what is left is within rounding of the average
+    for(auto i : small) { table->prob[i] = 1; table->alias[i] = i; }
+    for(auto i : large) { table->prob[i] = 1; table->alias[i] = i; }
+    return table;
+}
+
+/// pick an element with u, which is then rescaled to [0,1) to be reused
+inline int _shape_area_table_pick(ShapeAreaTable* table, float& u) {
+    int n = table->prob.size();
+    auto s = min(u,0.99999994f) * n;
+    auto i = min((int)s, n-1);
+    auto f = s - i;
+    auto p = table->prob[i];
+    if(f < p) { u = f / p; return i; }
+    else { u = (f - p) / (1 - p); return table->alias[i]; }
+}
+
+/// uniform baricentric coordinates over a triangle (in the convention of interpolate_baricentric_triangle)
+inline vec2f _shape_sample_triangle_uv(const vec2f& uv) {
+    auto su = sqrt(uv.x);
+    return vec2f(1-su, su*(1-uv.y));
+}
+
+/// shape that holds the samplable geometry (the tesselation of shapes without analytic sampling)
+inline Shape* _shape_sample_shape(Shape* shape) {
+    if(is<Sphere>(shape) or is<Quad>(shape) or is<Triangle>(shape)) return shape;
+    else if(shape->_tesselation) return _shape_sample_shape(shape->_tesselation);
+    else return shape;
+}
+
+void shape_sample_init(Shape* shape) {
+    shape = _shape_sample_shape(shape);
+    if(shape->_area_table and shape->_area_table->changes == shape->_changes) return;
+    shape_sample_clear(shape);
+    if(is<TriangleMesh>(shape)) {
+        auto mesh = cast<TriangleMesh>(shape);
+        shape->_area_table = _shape_area_table_build(mesh->triangle.size(), [mesh](int elementid){
+            auto f = mesh->triangle[elementid];
+            return triangle_area(mesh->pos[f.x], mesh->pos[f.y], mesh->pos[f.z]); });
+    }
+    else if(is<Mesh>(shape)) {
+        auto mesh = cast<Mesh>(shape);
+        shape->_area_table = _shape_area_table_build(mesh->triangle.size() + mesh->quad.size()*2, [mesh](int elementid){
+            auto f = mesh_triangle_face(mesh, elementid);
+            return triangle_area(mesh->pos[f.x], mesh->pos[f.y], mesh->pos[f.z]); });
+    }
+    else if(is<FaceMesh>(shape)) {
+        auto mesh = cast<FaceMesh>(shape);
+        shape->_area_table = _shape_area_table_build(mesh->triangle.size() + mesh->quad.size()*2, [mesh](int elementid){
+            auto f = facemesh_triangle_face(mesh, elementid);
+            return triangle_area(mesh->pos[mesh->vertex[f.x].x], mesh->pos[mesh->vertex[f.y].x], mesh->pos[mesh->vertex[f.z].x]); });
+    }
+    if(shape->_area_table) shape->_area_table->changes = shape->_changes;
+}
+
+void shape_sample_clear(Shape* shape) {
+    shape = _shape_sample_shape(shape);
+    if(shape->_area_table) { delete shape->_area_table; shape->_area_table = nullptr; }
+}
+
+/// sample n points over the elements of a mesh, with element_frame(elementid,uv) giving the frame at baricentric coordinates uv
+template<typename F>
+void _shape_sample_elements(ShapeAreaTable* table, const vec2f* uv, ShapeSample* samples, int n, const F& element_frame) {
+    for(int i = 0; i < n; i ++) {
+        auto u = uv[i].x;
+        auto elementid = _shape_area_table_pick(table, u);
+        samples[i].frame = element_frame(elementid, _shape_sample_triangle_uv(vec2f(u,uv[i].y)));
+        samples[i].area = table->area;
+    }
+}
+
+void shape_sample_uniform(Shape* shape, const vec2f* uv, ShapeSample* samples, int n) {
+    shape = _shape_sample_shape(shape);
     if(is<Sphere>(shape)) {
         auto sphere = cast<Sphere>(shape);
-        // see: http://mathworld.wolfram.com/SpherePointPicking.html
-        float z = 1 - 2*uv.y;
-        float rxy = sqrt(1-z*z);
-        float phi = 2*pif*uv.x;
-        vec3f pl = vec3f(rxy*cos(phi),rxy*sin(phi),z);
-        auto sss = ShapeSample();
-        sss.frame.o = sphere->center + pl * sphere->radius;
-        sss.frame.z = normalize(pl);
-        sss.frame = orthonormalize(sss.frame);
-        sss.area = sphere_area(sphere->radius);
-        return sss;
+        for(int i = 0; i < n; i ++) {
+            // see: http://mathworld.wolfram.com/SpherePointPicking.html
+            float z = 1 - 2*uv[i].y;
+            float rxy = sqrt(1-z*z);
+            float phi = 2*pif*uv[i].x;
+            vec3f pl = vec3f(rxy*cos(phi),rxy*sin(phi),z);
+            auto sss = ShapeSample();
+            sss.frame.o = sphere->center + pl * sphere->radius;
+            sss.frame.z = normalize(pl);
+            sss.frame = orthonormalize(sss.frame);
+            sss.area = sphere_area(sphere->radius);
+            samples[i] = sss;
+        }
     }
     else if(is<Quad>(shape)) {
         auto quad = cast<Quad>(shape);
-        auto sss = ShapeSample();
-        sss.frame = identity_frame3f;
-        sss.frame.o = (uv.x-0.5f)*quad->width*x3f + (uv.y-0.5f)*quad->height*y3f;
-        sss.area = quad->width * quad->height;
-        return sss;
+        for(int i = 0; i < n; i ++) {
+            auto sss = ShapeSample();
+            sss.frame = identity_frame3f;
+            sss.frame.o = (uv[i].x-0.5f)*quad->width*x3f + (uv[i].y-0.5f)*quad->height*y3f;
+            sss.area = quad->width * quad->height;
+            samples[i] = sss;
+        }
+    }
+    else if(is<Triangle>(shape)) {
+        auto triangle = cast<Triangle>(shape);
+        for(int i = 0; i < n; i ++) {
+            samples[i].frame = orthonormalize(triangle_frame(triangle, _shape_sample_triangle_uv(uv[i])));
+            samples[i].area = triangle_area(triangle->v0, triangle->v1, triangle->v2);
+        }
+    }
+    else if(is<TriangleMesh>(shape)) {
+        auto mesh = cast<TriangleMesh>(shape);
+        shape_sample_init(mesh);
+        _shape_sample_elements(mesh->_area_table, uv, samples, n, [mesh](int elementid, const vec2f& uv){ return trianglemesh_frame(mesh, elementid, uv); });
+    }
+    else if(is<Mesh>(shape)) {
+        auto mesh = cast<Mesh>(shape);
+        shape_sample_init(mesh);
+        _shape_sample_elements(mesh->_area_table, uv, samples, n, [mesh](int elementid, const vec2f& uv){ return mesh_frame(mesh, elementid, uv); });
     }
-    else { not_implemented_error(); return ShapeSample(); }
+    else if(is<FaceMesh>(shape)) {
+        auto mesh = cast<FaceMesh>(shape);
+        shape_sample_init(mesh);
+        _shape_sample_elements(mesh->_area_table, uv, samples, n, [mesh](int elementid, const vec2f& uv){ return facemesh_frame(mesh, elementid, uv); });
+    }
+    else not_implemented_error();
+}
+
+ShapeSample shape_sample_uniform(Shape* shape, const vec2f& uv) {
+    auto sss = ShapeSample();
+    shape_sample_uniform(shape, &uv, &sss, 1);
+    return sss;
 }
 
 vector<vec3f>* shape_get_pos(Shape* shape) {
@@ -239,20 +452,20 @@ bool shape_has_smooth_frames(Shape* shape) {
 void shape_smooth_frames(Shape* shape) {
     if(is<TriangleMesh>(shape)) {
         auto mesh = cast<TriangleMesh>(shape);
-        mesh->norm.resize(mesh->pos.size(),zero3f);
+        mesh->norm.assign(mesh->pos.size(),zero3f);
         for(auto f : mesh->triangle) for(auto vid : f) mesh->norm[vid] += triangle_normal(mesh->pos[f.x],mesh->pos[f.y],mesh->pos[f.z]);
         for(auto &n : mesh->norm) n = normalize(n);
     }
     else if(is<Mesh>(shape)) {
         auto mesh = cast<Mesh>(shape);
-        mesh->norm.resize(mesh->pos.size(),zero3f);
+        mesh->norm.assign(mesh->pos.size(),zero3f);
         for(auto f : mesh->triangle) for(auto vid : f) mesh->norm[vid] += triangle_normal(mesh->pos[f.x],mesh->pos[f.y],mesh->pos[f.z]);
         for(auto f : mesh->quad) for(auto vid : f) mesh->norm[vid] += quad_normal(mesh->pos[f.x],mesh->pos[f.y],mesh->pos[f.z],mesh->pos[f.w]);
         for(auto &n : mesh->norm) n = normalize(n);
     }
     else if(is<FaceMesh>(shape)) {
         auto mesh = cast<FaceMesh>(shape);
-        mesh->norm.resize(mesh->norm.size(), zero3f);
+        mesh->norm.assign(mesh->norm.size(), zero3f);
         for(auto f : mesh->triangle) for(auto vid : f) mesh->norm[mesh->vertex[vid].y] += triangle_normal(mesh->pos[mesh->vertex[f.x].x],mesh->pos[mesh->vertex[f.y].x],mesh->pos[mesh->vertex[f.z].x]);
         for(auto f : mesh->quad) for(auto vid : f) mesh->norm[mesh->vertex[vid].y] += quad_normal(mesh->pos[mesh->vertex[f.x].x],mesh->pos[mesh->vertex[f.y].x],mesh->pos[mesh->vertex[f.z].x],mesh->pos[mesh->vertex[f.w].x]);
         for(auto &n : mesh->norm) n = normalize(n);
@@ -9,9 +9,27 @@
 ///@ingroup igl
 ///@{
 
+struct BVH;
+struct ShapeAreaTable;
+struct ShapeDrawBuffers;
+struct TesselationLevels;
+
 /// Abstract Shape
 struct Shape : Node {
     Shape*              _tesselation = nullptr; ///< shape tesselation
+    TesselationLevels*  _levels = nullptr; ///< coarser tesselations, to draw the shape when small on screen (see shape_tesselation_init)
+    BVH*                _bvh = nullptr; ///< intersection acceleration structure (built lazily)
+    ShapeAreaTable*     _area_table = nullptr; ///< element sampling table (built lazily)
+    ShapeDrawBuffers*   _draw_buffers = nullptr; ///< copy of the vertex data on the gpu (built lazily when drawn)
+    int                 _changes = 0; ///< number of changes to the vertex data (see shape_changed)
+
+    Shape() { }
+    /// Copy constructor: copies are usually modified after cloning, so they do not share the acceleration structure, sampling table, draw buffers and coarser tesselations
+    Shape(const Shape& shape) : Node(shape), _tesselation(shape._tesselation) { }
+    /// Assignment: as for the copy constructor, the acceleration structure, sampling table, draw buffers and coarser tesselations are not shared
+    Shape& operator=(const Shape& shape);
+    /// Destructor (releases the acceleration structure, sampling table, draw buffers and coarser tesselations)
+    virtual ~Shape();
 };
 
 /// Sphere aligned along Z axis
@@ -95,6 +113,20 @@ struct FaceMesh : Shape {
     vector<vec4i>       quad; ///< quad list with four vertex indices per quad
     
     vector<vec2i>       _tesselation_lines; ///< highkighted line segments (used for tesselation)
+    
+    Mesh*               _mesh = nullptr; ///< copy with a single index per vertex, for drawing and intersection (see facemesh_mesh)
+    vector<int>         _mesh_vertex; ///< vertex of each vertex of the copy
+    int                 _mesh_changes = 0; ///< shape changes when the copy was updated
+    int                 _mesh_nvertex = 0; ///< number of vertices when the copy was built
+    
+    FaceMesh() { }
+    /// Copy constructor: as for shapes, copies do not share the single index copy
+    FaceMesh(const FaceMesh& mesh) : Shape(mesh), pos(mesh.pos), norm(mesh.norm), texcoord(mesh.texcoord),
+        vertex(mesh.vertex), triangle(mesh.triangle), quad(mesh.quad), _tesselation_lines(mesh._tesselation_lines) { }
+    /// Assignment: as for the copy constructor, the single index copy is not shared
+    FaceMesh& operator=(const FaceMesh& mesh);
+    /// Destructor (releases the single index copy)
+    ~FaceMesh() { if(_mesh) delete _mesh; }
 };
 
 /// Catmull-Clark subdivision surface on a pure quad mesh
@@ -235,6 +267,10 @@ inline vec3i mesh_triangle_face(Mesh* mesh, int elementid) {
         else return vec3i(f.x,f.z,f.w);
     }
 }
+/// copy of a face mesh with a single index per vertex, merging the vertices with the same position, normal and texcoord indices,
+/// so that it can be drawn and intersected as a mesh (with the same elements); the copy is kept in the face mesh and updated
+/// when the mesh is marked by shape_changed, or made again when its counts change
+Mesh* facemesh_mesh(FaceMesh* mesh);
 inline vec3i facemesh_triangle_face(FaceMesh* mesh, int elementid) {
     if(elementid < mesh->triangle.size()) return mesh->triangle[elementid];
     else {
@@ -245,6 +281,12 @@ inline vec3i facemesh_triangle_face(FaceMesh* mesh, int elementid) {
 }
 ///@}
 
+///@name shape change interface
+///@{
+/// mark the vertex data of a shape as changed (positions, normals or element counts), so that copies of it are updated
+inline void shape_changed(Shape* shape) { shape->_changes ++; }
+///@}
+
 ///@name vertex access interface
 ///@{
 vector<vec3f>* shape_get_pos(Shape* shape);
@@ -259,7 +301,25 @@ struct ShapeSample {
     float       area = 1; ///< shape area
 };
 
+/// Alias table over the elements of a mesh, to pick elements proportionally to their area in constant time
+/// (see: Vose, "A linear algorithm for generating random numbers with a given distribution", 1991)
+struct ShapeAreaTable {
+    vector<float>       prob; ///< probability of keeping each element instead of its alias
+    vector<int>         alias; ///< alias of each element
+    float               area = 0; ///< total area
+    int                 changes = 0; ///< shape changes when built
+};
+
+/// sample a point uniformly over the shape area; meshes pick an element from the area table with uv.x,
+/// then reuse what is left of uv.x to place the point in the element
 ShapeSample shape_sample_uniform(Shape* shape, const vec2f& uv);
+/// sample n points at once (same results as shape_sample_uniform, but the shape is looked up only once)
+void shape_sample_uniform(Shape* shape, const vec2f* uv, ShapeSample* samples, int n);
+/// build the area table of meshes, if not built yet or if the shape changed since (see shape_changed); sampling
+/// builds it lazily, which is not thread safe, so call this before sampling from parallel loops
+void shape_sample_init(Shape* shape);
+/// release the area table
+void shape_sample_clear(Shape* shape);
 ///@}
 
 ///@name shape frame smoothing interface
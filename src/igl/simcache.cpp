@@ -0,0 +1,242 @@
+#include "simcache.h"
+#include "intersect.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+///@file igl/simcache.cpp Simulation Cache. @ingroup igl
+
+/// header of baked files; it is followed by the offsets of the records of each frame and simulated surface
+/// (frame major, as uint64_t), then by the records: particle count and shape type (as int32_t), then the positions
+/// and either the radia (PointSet) or the normals (Mesh)
+struct _SimulationBakeHeader {
+    char        magic[8]; ///< simcache_bake_magic
+    int32_t     nframes; ///< number of frames
+    int32_t     nprims; ///< number of simulated surfaces
+    float       fps; ///< frames per second
+    int32_t     reserved; ///< unused (keeps the offsets 8 bytes aligned)
+};
+
+/// record shape types of baked files
+enum { _simcache_bake_pointset = 0, _simcache_bake_mesh = 1 };
+
+void simcache_init(SimulationCache* cache, Scene* scene) {
+    scene_simulation_init(scene);
+    cache->time = 0;
+    cache->_snapshots.clear();
+    // the initial state is always kept, since simulation init starts from the current shapes (and so cannot restart)
+    if(cache->_bake) simcache_bake_load(cache->_bake, scene, 0);
+    else cache->_snapshots.push_back(simcache_snapshot(scene, 0));
+}
+
+/// simulate forward by dt, taking a snapshot when past the interval from the last one
+void _simcache_step(SimulationCache* cache, Scene* scene, float dt) {
+    scene_simulation_update(scene, dt);
+    cache->time += dt;
+    if(cache->snapshot_interval > 0 and cache->time >= cache->_snapshots.back().time + cache->snapshot_interval - simcache_time_epsilon)
+        cache->_snapshots.push_back(simcache_snapshot(scene, cache->time));
+}
+
+void simcache_update(SimulationCache* cache, Scene* scene, float dt) {
+    if(dt < 0 or cache->_bake) simcache_seek(cache, scene, cache->time + dt);
+    else _simcache_step(cache, scene, dt);
+}
+
+void simcache_seek(SimulationCache* cache, Scene* scene, float time) {
+    time = max(time, 0.0f);
+    if(cache->_bake) {
+        auto frame = clamp((int)round(time * cache->_bake->fps), 0, cache->_bake->nframes-1);
+        simcache_bake_load(cache->_bake, scene, frame);
+        cache->time = frame / cache->_bake->fps;
+        return;
+    }
+
+    // restore the last snapshot before time, unless simulating forward from the current time is shorter
+    auto snapshot = std::upper_bound(cache->_snapshots.begin(), cache->_snapshots.end(), time,
+                                     [](float time, const SimulationSnapshot& snapshot){ return time < snapshot.time; });
+    if(time < cache->time or (snapshot-1)->time > cache->time) {
+        simcache_restore(scene, *(snapshot-1));
+        cache->time = (snapshot-1)->time;
+    }
+
+    // full playback steps, so that seeking to a frame gives the frame played back, then the remainder
+    while(cache->time < time - simcache_time_epsilon) {
+        auto dt = time - cache->time;
+        _simcache_step(cache, scene, (dt > cache->seek_step - simcache_time_epsilon) ? cache->seek_step : dt);
+    }
+}
+
+SimulationSnapshot simcache_snapshot(Scene* scene, float time) {
+    auto snapshot = SimulationSnapshot();
+    snapshot.time = time;
+    for(auto prim : scene->prims->prims) {
+        if(not is<SimulatedSurface>(prim)) continue;
+        auto simulated = cast<SimulatedSurface>(prim);
+        auto state = SimulatedSurfaceState();
+        state.particles = simulated->_simulator->particles;
+        state.implicit_dv = simulated->_simulator->_implicit_dv;
+        if(is<ParticleSystem>(prim)) {
+            state.updates = cast<ParticleSystem>(prim)->_updates;
+            state.emitted = cast<ParticleSystem>(prim)->_emitted;
+        }
+        snapshot.prims.push_back(state);
+    }
+    return snapshot;
+}
+
+void simcache_restore(Scene* scene, const SimulationSnapshot& snapshot) {
+    int p = 0;
+    for(auto prim : scene->prims->prims) {
+        if(not is<SimulatedSurface>(prim)) continue;
+        error_if_not(p < snapshot.prims.size(), "snapshot does not match the scene");
+        auto simulated = cast<SimulatedSurface>(prim);
+        auto& state = snapshot.prims[p++];
+        // assignments keep the reserved storage of the particles
+        simulated->_simulator->particles = state.particles;
+        simulated->_simulator->_implicit_dv = state.implicit_dv;
+        if(is<ParticleSystem>(prim)) {
+            cast<ParticleSystem>(prim)->_updates = state.updates;
+            cast<ParticleSystem>(prim)->_emitted = state.emitted;
+        }
+        primitive_simulation_sync(simulated);
+    }
+    error_if_not(p == snapshot.prims.size(), "snapshot does not match the scene");
+    primitives_bvh_refit(scene->prims);
+}
+
+/// write the record of the simulated shape of a surface
+void _simcache_bake_write(FILE* file, SimulatedSurface* simulated) {
+    if(is<PointSet>(simulated->_shape)) {
+        auto points = cast<PointSet>(simulated->_shape);
+        int32_t record[2] = { (int32_t)points->pos.size(), _simcache_bake_pointset };
+        fwrite(record, sizeof(record), 1, file);
+        fwrite(points->pos.data(), sizeof(vec3f), points->pos.size(), file);
+        fwrite(points->radius.data(), sizeof(float), points->radius.size(), file);
+    }
+    else if(is<Mesh>(simulated->_shape)) {
+        auto mesh = cast<Mesh>(simulated->_shape);
+        int32_t record[2] = { (int32_t)mesh->pos.size(), _simcache_bake_mesh };
+        fwrite(record, sizeof(record), 1, file);
+        fwrite(mesh->pos.data(), sizeof(vec3f), mesh->pos.size(), file);
+        fwrite(mesh->norm.data(), sizeof(vec3f), mesh->norm.size(), file);
+    }
+    else not_implemented_error();
+}
+
+void simcache_bake(Scene* scene, const string& filename, float fps, int nframes) {
+    auto file = fopen(filename.c_str(), "wb");
+    error_if_not(file, "cannot write baked file");
+
+    auto prims = vector<SimulatedSurface*>();
+    for(auto prim : scene->prims->prims) if(is<SimulatedSurface>(prim)) prims.push_back(cast<SimulatedSurface>(prim));
+
+    auto header = _SimulationBakeHeader();
+    memcpy(header.magic, simcache_bake_magic, sizeof(header.magic));
+    header.nframes = nframes;
+    header.nprims = prims.size();
+    header.fps = fps;
+    header.reserved = 0;
+    fwrite(&header, sizeof(header), 1, file);
+
+    // offsets are known once the records are written, so they are written last over a placeholder
+    auto offsets = vector<uint64_t>(nframes*prims.size());
+    fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), file);
+    for(int frame = 0; frame < nframes; frame ++) {
+        // fixed updates as in playback, so that baked frames match the simulated ones
+        if(frame > 0) scene_simulation_update(scene, 1 / fps);
+        for(int p = 0; p < prims.size(); p ++) {
+            offsets[frame*prims.size()+p] = ftell(file);
+            _simcache_bake_write(file, prims[p]);
+        }
+    }
+    fseek(file, sizeof(header), SEEK_SET);
+    fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), file);
+    fclose(file);
+}
+
+SimulationBake* simcache_bake_open(const string& filename) {
+    auto bake = new SimulationBake();
+#ifdef _WIN32
+    // no mmap, so read the whole file
+    auto stream = std::ifstream(filename, std::ios::binary | std::ios::ate);
+    error_if_not(stream.good(), "cannot read baked file");
+    bake->_size = stream.tellg();
+    auto data = new char[bake->_size];
+    stream.seekg(0);
+    stream.read(data, bake->_size);
+    bake->_data = data;
+#else
+    auto fd = open(filename.c_str(), O_RDONLY);
+    error_if_not(fd >= 0, "cannot read baked file");
+    struct stat st;
+    fstat(fd, &st);
+    bake->_size = st.st_size;
+    auto data = mmap(nullptr, bake->_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    error_if_not(data != MAP_FAILED, "cannot map baked file");
+    bake->_data = (const char*)data;
+#endif
+    error_if_not(bake->_size >= sizeof(_SimulationBakeHeader), "baked file is truncated");
+    auto header = (const _SimulationBakeHeader*)bake->_data;
+    error_if_not(memcmp(header->magic, simcache_bake_magic, sizeof(header->magic)) == 0, "not a baked file");
+    bake->nframes = header->nframes;
+    bake->nprims = header->nprims;
+    bake->fps = header->fps;
+    error_if_not(bake->_size >= sizeof(_SimulationBakeHeader) + sizeof(uint64_t)*bake->nframes*bake->nprims, "baked file is truncated");
+    return bake;
+}
+
+void simcache_bake_close(SimulationBake* bake) {
+#ifdef _WIN32
+    delete [] bake->_data;
+#else
+    munmap((void*)bake->_data, bake->_size);
+#endif
+    delete bake;
+}
+
+void simcache_bake_load(SimulationBake* bake, Scene* scene, int frame) {
+    error_if_not(frame >= 0 and frame < bake->nframes, "baked frame out of range");
+    auto offsets = (const uint64_t*)(bake->_data + sizeof(_SimulationBakeHeader));
+    int p = 0;
+    for(auto prim : scene->prims->prims) {
+        if(not is<SimulatedSurface>(prim)) continue;
+        error_if_not(p < bake->nprims, "baked file does not match the scene");
+        auto simulated = cast<SimulatedSurface>(prim);
+        auto record = bake->_data + offsets[frame*bake->nprims+(p++)];
+        auto n = ((const int32_t*)record)[0];
+        auto type = ((const int32_t*)record)[1];
+        auto pos = (const vec3f*)(record + 2*sizeof(int32_t));
+        auto attribute_size = (type == _simcache_bake_pointset) ? sizeof(float) : sizeof(vec3f);
+        error_if_not(record + 2*sizeof(int32_t) + n*(sizeof(vec3f)+attribute_size) <= bake->_data + bake->_size, "baked file is truncated");
+        if(type == _simcache_bake_pointset) {
+            error_if_not(is<PointSet>(simulated->_shape), "baked file does not match the scene");
+            auto points = cast<PointSet>(simulated->_shape);
+            auto radius = (const float*)(pos + n);
+            points->pos.assign(pos, pos + n);
+            points->radius.assign(radius, radius + n);
+        }
+        else if(type == _simcache_bake_mesh) {
+            error_if_not(is<Mesh>(simulated->_shape), "baked file does not match the scene");
+            auto mesh = cast<Mesh>(simulated->_shape);
+            auto norm = pos + n;
+            mesh->pos.assign(pos, pos + n);
+            mesh->norm.assign(norm, norm + n);
+        }
+        else error("unknown baked shape type");
+        shape_changed(simulated->_shape);
+        shape_bvh_refit(simulated->_shape);
+    }
+    error_if_not(p == bake->nprims, "baked file does not match the scene");
+    primitives_bvh_refit(scene->prims);
+}
@@ -0,0 +1,85 @@
+#ifndef _SIMCACHE_H_
+#define _SIMCACHE_H_
+
+#include "scene.h"
+
+#include <cstdint>
+
+///@file igl/simcache.h Simulation Cache. @ingroup igl
+///@defgroup simcache Simulation Cache
+///@ingroup igl
+///@{
+
+/// Simulation state of a simulated surface (what primitive_simulation_init does not recompute)
+struct SimulatedSurfaceState {
+    ParticleArrays          particles; ///< particles
+    vector<vec3f>           implicit_dv; ///< initial guess of the next implicit step
+    int                     updates = 0; ///< particle system updates
+    int                     emitted = 0; ///< particle system particles created
+};
+
+/// Simulation state of a scene at a given time
+struct SimulationSnapshot {
+    float                           time = 0; ///< simulation time
+    vector<SimulatedSurfaceState>   prims; ///< state of each simulated surface, in scene order
+};
+
+/// Simulation frames baked to disk, with the positions of the simulated shapes at a fixed frame rate;
+/// the file is memory mapped and frames are copied to the shapes as they are played back
+struct SimulationBake {
+    int                     nframes = 0; ///< number of frames (frame k is at time k / fps)
+    int                     nprims = 0; ///< number of simulated surfaces
+    float                   fps = 30; ///< frames per second
+
+    const char*             _data = nullptr; ///< mapped file
+    size_t                  _size = 0; ///< mapped file size
+};
+
+/// Scene simulation with snapshots taken at regular intervals, so that seeking restores the closest one
+/// instead of simulating from the start, and optional baked frames played back instead of simulating
+struct SimulationCache {
+    float                       snapshot_interval = 1; ///< simulation time between snapshots (0 to only keep the initial state)
+    float                       seek_step = 1/30.0f; ///< update time when simulating forward to a seeked time (the playback one, so that seeking matches playback)
+
+    float                       time = 0; ///< simulation time
+    vector<SimulationSnapshot>  _snapshots; ///< snapshots, sorted by time (the first is the initial state)
+    SimulationBake*             _bake = nullptr; ///< baked frames, played back instead of simulating (if any)
+};
+
+///@name simulation cache parameters
+///@{
+const char simcache_bake_magic[8] = { 'I','G','L','B','A','K','E','1' }; ///< tag at the start of baked files
+const float simcache_time_epsilon = 1e-5f; ///< time differences ignored when seeking (float rounding of accumulated updates)
+///@}
+
+///@name simulation cache interface
+///@{
+/// (re)start the scene simulation at time 0, dropping the snapshots (but not the baked frames);
+/// like scene_simulation_init, the simulation starts from the current shapes, so call it after tesselation init
+void simcache_init(SimulationCache* cache, Scene* scene);
+/// advance the simulation by dt; negative dt seek backward
+void simcache_update(SimulationCache* cache, Scene* scene, float dt);
+/// move the simulation to time: shows the closest baked frame if any, otherwise restores the last snapshot
+/// before time (unless the simulation is already between it and time) and simulates forward from there
+void simcache_seek(SimulationCache* cache, Scene* scene, float time);
+/// save the simulation state of the scene
+SimulationSnapshot simcache_snapshot(Scene* scene, float time);
+/// restore a simulation state saved from the same scene
+void simcache_restore(Scene* scene, const SimulationSnapshot& snapshot);
+///@}
+
+///@name baked simulation interface
+///@{
+/// simulate the scene, just initialized, for nframes frames at fps and save the simulated shapes of each frame to filename
+void simcache_bake(Scene* scene, const string& filename, float fps, int nframes);
+/// map a baked file
+SimulationBake* simcache_bake_open(const string& filename);
+/// unmap a baked file
+void simcache_bake_close(SimulationBake* bake);
+/// copy a baked frame to the simulated shapes of the scene it was baked from
+void simcache_bake_load(SimulationBake* bake, Scene* scene, int frame);
+///@}
+
+///@}
+
+#endif
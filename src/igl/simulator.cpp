@@ -1,67 +1,498 @@
 #include "simulator.h"
 
 #include "intersect.h"
+#include "common/parallel.h"
 
 ///@file igl/simulator.cpp Simulation. @ingroup igl
 
+/// Sizes the implicit step scratch arrays to the springs and particles (no-op if they already match)
+void _simulator_implicit_resize(ParticleSimulator* simulator) {
+    if(not simulator->implicit) return;
+    auto n = simulator->particles.size();
+    simulator->_implicit_spring_dfdx.resize(simulator->springs.size());
+    simulator->_implicit_spring_k.resize(simulator->springs.size());
+    simulator->_implicit_r.resize(n); simulator->_implicit_z.resize(n);
+    simulator->_implicit_p.resize(n); simulator->_implicit_q.resize(n);
+    simulator->_implicit_diag_inv.resize(n);
+}
+
+/// Builds the adjacency from each particle to its springs, listed in spring order so that gathering
+/// their forces sums them in the same order as scattering them spring by spring
+void simulator_springs_init(ParticleSimulator* simulator) {
+    auto& offsets = simulator->_spring_offsets;
+    auto& adjacency = simulator->_spring_adjacency;
+    offsets.assign(simulator->particles.size()+1, 0);
+    for(auto& spring : simulator->springs) { offsets[spring.i+1] ++; offsets[spring.j+1] ++; }
+    for(int i = 0; i < simulator->particles.size(); i ++) offsets[i+1] += offsets[i];
+    adjacency.resize(offsets.back());
+    auto next = vector<int>(offsets.begin(), offsets.end()-1);
+    for(int s = 0; s < simulator->springs.size(); s ++) {
+        adjacency[next[simulator->springs[s].i]++] = 2*s+0;
+        adjacency[next[simulator->springs[s].j]++] = 2*s+1;
+    }
+    simulator->_spring_force.resize(simulator->springs.size());
+    _simulator_implicit_resize(simulator);
+    
+    // explicit steps are stable below 2 over the largest eigenvalues of the stiffness and damping over mass,
+    // bounded per particle by twice the sum of the coefficients of its springs (Gershgorin)
+    simulator->_spring_dt = 0;
+    for(int i = 0; i < simulator->particles.size(); i ++) {
+        if(simulator->particles.pinned[i] or offsets[i] == offsets[i+1]) continue;
+        auto ks = 0.0f, kd = 0.0f;
+        for(int a = offsets[i]; a < offsets[i+1]; a ++) { ks += simulator->springs[adjacency[a]/2].ks; kd += simulator->springs[adjacency[a]/2].kd; }
+        auto mass = simulator->particles.mass[i];
+        auto dt = 2 / (sqrt(2*ks/mass) + 2*kd/mass);
+        if(simulator->_spring_dt == 0 or dt < simulator->_spring_dt) simulator->_spring_dt = dt;
+    }
+}
+
+/// Computes the collider bounds used to skip the colliders far from a particle, and builds the collider
+/// shape acceleration structures up front, since building them lazily from parallel passes is not safe
+void simulator_colliders_init(ParticleSimulator* simulator) {
+    for(auto& collider : simulator->colliders) {
+        shape_bvh_init(collider.shape);
+        collider._bounds = transform_bbox(collider.frame, intersect_shape_bounds(collider.shape));
+    }
+}
+
+/// lowers *value to v if smaller (from multiple threads)
+inline void _simulator_atomic_min(float* value, float v) {
+    float current;
+    __atomic_load(value, &current, __ATOMIC_RELAXED);
+    while(v < current and not __atomic_compare_exchange(value, &current, &v, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) { }
+}
+
+/// The stable step is limited by the springs, for explicit integration, by the integration error, which grows as
+/// the particle acceleration times the step squared, and by the particle motion: particles should move less than
+/// their radius (or than the self collision distance), unless they are farther from all colliders bounds, in which
+/// case they can move up to there. Accelerations are the ones of the last step (simulator_update evaluates them
+/// before its first estimate); the spring and motion limits are scaled by adaptive_cfl. Each range starts from the
+/// same limit and only the atomic minimum writes the result, so it is the same for any number of threads.
+float simulator_stable_dt(ParticleSimulator* simulator, float max_dt) {
+    auto start_dt = max_dt;
+    if(not simulator->implicit and simulator->_spring_dt > 0) start_dt = min(max_dt, simulator->adaptive_cfl * simulator->_spring_dt);
+    simulator->_stable_dt = start_dt;
+    parallel_for(simulator->particles.size(), simulator_parallel_grain, [simulator,start_dt](int start, int end) {
+        auto& particles = simulator->particles;
+        auto cfl = simulator->adaptive_cfl;
+        auto collide = not simulator->colliders.empty() or simulator->self_collision > 0;
+        auto stable_dt = start_dt;
+        for(int i = start; i < end; i ++) {
+            if(particles.pinned[i]) continue;
+            auto accel = length(particles._force[i]) / particles.mass[i];
+            auto error = simulator->adaptive_tolerance * particles.radius[i];
+            if(accel * stable_dt * stable_dt > error) stable_dt = sqrt(error / accel);
+            if(not collide) continue;
+            auto limit = particles.radius[i];
+            if(simulator->self_collision > 0) limit = min(limit, simulator->self_collision);
+            else {
+                auto gap = -1.0f;
+                for(auto& collider : simulator->colliders) {
+                    auto d = length(max(max(collider._bounds.min - particles.pos[i], particles.pos[i] - collider._bounds.max), zero3f));
+                    if(gap < 0 or d < gap) gap = d;
+                }
+                limit = max(limit, gap);
+            }
+            auto distance = cfl * limit;
+            // solves speed * dt + accel * dt^2 / 2 = distance
+            auto speed = length(particles.vel[i]);
+            auto den = speed + sqrt(speed*speed + 2*accel*distance);
+            if(den > 0 and 2*distance < stable_dt*den) stable_dt = 2*distance/den;
+        }
+        _simulator_atomic_min(&simulator->_stable_dt, stable_dt);
+    });
+    return simulator->_stable_dt;
+}
+
+void _simulator_forces(ParticleSimulator* simulator);
+
 /// Updates the simulated data by stepping over the time delta given simulator->steps_per_sec
 /// @param simulator Contains data to update and functions to perform the update
 /// @param dt The number of seconds to advance the simulator (time delta)
 void simulator_update(ParticleSimulator* simulator, float dt) {
     int steps = round(simulator->steps_per_sec * dt);
-    float ddt = dt / steps;
+    auto& stats = simulator->stats;
+    stats.updates ++;
+    stats.steps_fixed += steps;
+    stats.update_steps = 0;
     simulator->begin_update(dt);
+    // adaptive updates estimate the stable step before each step, and spread what is left of the update evenly
+    // over the steps it needs, up to the fixed number of steps
+    // the first estimate needs the forces of the current state: after init, a restore or emission,
+    // the forces left by the last step are missing or stale
+    if(simulator->adaptive) _simulator_forces(simulator);
+    auto left = dt;
     for(int i = 0; i < steps; i ++) {
-        simulator->begin_step(ddt);
+        auto n = steps - i;
+        if(simulator->adaptive) {
+            auto needed = left / simulator_stable_dt(simulator, left);
+            if(needed < n) n = max(1, (int)ceil(needed));
+        }
+        float ddt = (simulator->adaptive) ? left / n : dt / steps;
+        if(simulator->begin_step) simulator->begin_step(ddt);
         simulator_update_step(simulator,ddt);
-        simulator->end_step(ddt);
+        if(simulator->end_step) simulator->end_step(ddt);
+        stats.update_steps ++;
+        stats.step_min = (stats.step_min > 0) ? min(stats.step_min, ddt) : ddt;
+        stats.step_max = max(stats.step_max, ddt);
+        if(n == 1) break;
+        left -= ddt;
     }
+    stats.steps += stats.update_steps;
     simulator->end_update(dt);
 }
 
+/// Computes the force of springs [start,end) on their i end
+void _simulator_spring_forces(ParticleSimulator* simulator, int start, int end) {
+    auto& particles = simulator->particles;
+    for(int i = start; i < end; i++) {
+        auto pi = simulator->springs[i].i;
+        auto pj = simulator->springs[i].j;
+        auto pipj = particles.pos[pi] - particles.pos[pj];
+        auto l = length(pipj);
+        auto e = pipj / l;
+        auto v1 = dot(e, particles.vel[pi]);
+        auto v2 = dot(e, particles.vel[pj]);
+        auto fsd = -simulator->springs[i].ks * (l - simulator->springs[i].l) - simulator->springs[i].kd * (v1 - v2);
+        simulator->_spring_force[i] = e * fsd;
+    }
+}
+
+/// Sets the forces of particles [start,end) by gathering their spring forces and adding the external forces
+void _simulator_particle_forces(ParticleSimulator* simulator, int start, int end) {
+    auto& particles = simulator->particles;
+    auto& forces = simulator->forces;
+    auto force = particles._force.data();
+    auto vel = particles.vel.data();
+    auto mass = particles.mass.data();
+    for(int i = start; i < end; i++) force[i] = zero3f;
+    if(not simulator->springs.empty()) {
+        auto offsets = simulator->_spring_offsets.data();
+        auto adjacency = simulator->_spring_adjacency.data();
+        auto spring_force = simulator->_spring_force.data();
+        for(int i = start; i < end; i++) {
+            for(int k = offsets[i]; k < offsets[i+1]; k++) {
+                auto f1 = spring_force[adjacency[k]/2];
+                force[i] += (adjacency[k]%2) ? -f1 : f1;
+            }
+        }
+    }
+    for(int i = start; i < end; i++) force[i] += (forces.wind - vel[i]) * forces.airfriction + forces.gravity * mass[i];
+    if(simulator->force) simulator->force(particles, start, end);
+}
+
+/// Computes the spring forces; each spring force is computed once, then gathered by its two particles,
+/// so that no two threads write the same particle and the sums do not depend on the number of threads
+void _simulator_springs_update(ParticleSimulator* simulator) {
+    if(not simulator->springs.empty() and simulator->_spring_offsets.size() != simulator->particles.size()+1) simulator_springs_init(simulator);
+    parallel_for(simulator->springs.size(), simulator_parallel_grain, [simulator](int start, int end) {
+        _simulator_spring_forces(simulator, start, end);
+    });
+}
+
+/// Computes the forces of all particles in their current state
+void _simulator_forces(ParticleSimulator* simulator) {
+    _simulator_springs_update(simulator);
+    parallel_for(simulator->particles.size(), simulator_parallel_grain, [simulator](int start, int end) {
+        _simulator_particle_forces(simulator, start, end);
+    });
+}
+
+/// Handles the collisions of particle i, that moved from prev during the last step, with the colliders whose bounds
+/// its motion overlaps: if its motion crossed the collider surface (traced as a ray, so that fast particles do not go
+/// through thin colliders), it is moved back at radius distance on the side it came from; otherwise if it is closer
+/// than its radius to the surface, it is pushed away from it; mesh colliders find their elements with their shape
+/// acceleration structure. The normal velocity is bounced back scaled by collision_dumping and the tangential
+/// velocity is reduced by Coulomb friction.
+void _simulator_collide(ParticleSimulator* simulator, int i, const vec3f& prev) {
+    auto& particles = simulator->particles;
+    auto radius = particles.radius[i];
+    for(auto& collider : simulator->colliders) {
+        auto pos = particles.pos[i];
+        if(not overlap(runion(sphere_bounds(prev,radius), sphere_bounds(pos,radius)), collider._bounds)) continue;
+        auto motion = pos - prev;
+        auto motion_length = length(motion);
+        auto contact = zero3f, norm = zero3f, closest = zero3f, closest_norm = zero3f;
+        intersection3f intersection;
+        if(motion_length > 0 and intersect_shape_first(collider.shape, transform_ray_inverse(collider.frame, ray3f(prev, motion / motion_length, 0, motion_length)), intersection)) {
+            contact = prev + motion * (intersection.ray_t / motion_length);
+            norm = faceforward(normalize(transform_normal(collider.frame, intersection.geom_norm)), motion);
+        }
+        else if(intersect_shape_closest(collider.shape, transform_point_inverse(collider.frame, pos), radius, closest, closest_norm)) {
+            contact = transform_point(collider.frame, closest);
+            if(length(pos - contact) > 0) norm = normalize(pos - contact);
+            else norm = faceforward(normalize(transform_normal(collider.frame, closest_norm)), motion);
+        }
+        else continue;
+        particles.pos[i] = contact + norm * radius;
+        
+        auto vn = dot(particles.vel[i], norm);
+        if(vn >= 0) continue;
+        auto dvn = -(1 + simulator->collision_dumping) * vn;
+        auto vt = particles.vel[i] - vn * norm;
+        auto vt_length = length(vt);
+        particles.vel[i] = (vn + dvn) * norm;
+        if(vt_length > 0) particles.vel[i] += vt * (max(0.0f, vt_length - simulator->collision_friction * dvn) / vt_length);
+    }
+}
+
+/// Whether particles i and j are connected by a spring
+inline bool _simulator_connected(ParticleSimulator* simulator, int i, int j) {
+    if(simulator->_spring_offsets.empty()) return false;
+    for(int a = simulator->_spring_offsets[i]; a < simulator->_spring_offsets[i+1]; a ++) {
+        auto& spring = simulator->springs[simulator->_spring_adjacency[a]/2];
+        if(spring.i == j or spring.j == j) return true;
+    }
+    return false;
+}
+
+/// Pushes apart the particles closer than simulator->self_collision that are not connected by a spring, and removes
+/// their approaching velocity, sharing corrections by inverse mass (pinned particles do not move); neighbors are found
+/// with the particle grid, with cells twice the distance; each particle gathers its own corrections from its neighbors
+/// before any is applied, so that the passes run in parallel and do not depend on the number of threads
+void _simulator_self_collide(ParticleSimulator* simulator) {
+    auto& particles = simulator->particles;
+    auto n = particles.size();
+    auto h = simulator->self_collision;
+    hashgrid_build(&simulator->_grid, particles.pos, 2*h);
+    auto& dpos = simulator->_self_collision_dpos;
+    auto& dvel = simulator->_self_collision_dvel;
+    dpos.assign(n, zero3f);
+    dvel.assign(n, zero3f);
+    parallel_for(n, simulator_parallel_grain, [simulator,&particles,&dpos,&dvel,h](int start, int end) {
+        for(int i = start; i < end; i ++) {
+            if(particles.pinned[i]) continue;
+            auto wi = 1 / particles.mass[i];
+            hashgrid_neighbors(&simulator->_grid, particles.pos, particles.pos[i], h, [&](int j) {
+                if(j == i or _simulator_connected(simulator, i, j)) return;
+                auto d = particles.pos[i] - particles.pos[j];
+                auto l = length(d);
+                if(l <= 0) return;
+                auto norm = d / l;
+                auto w = wi / (wi + ((particles.pinned[j]) ? 0 : 1 / particles.mass[j]));
+                dpos[i] += norm * ((h - l) * w);
+                auto vn = dot(particles.vel[i] - particles.vel[j], norm);
+                if(vn < 0) dvel[i] -= norm * (vn * w);
+            });
+        }
+    });
+    parallel_for(n, simulator_parallel_grain, [&particles,&dpos,&dvel](int start, int end) {
+        for(int i = start; i < end; i ++) { particles.pos[i] += dpos[i]; particles.vel[i] += dvel[i]; }
+    });
+}
+
+/// Outer product a b^T
+inline mat3f _outer(const vec3f& a, const vec3f& b) { return mat3f(b*a.x, b*a.y, b*a.z); }
+
+/// Sums body(start,end) over fixed blocks of [0,n) in parallel, then adds the block sums in order,
+/// so that the result does not depend on the number of threads
+double _simulator_parallel_sum(int n, const function<double (int,int)>& body) {
+    auto nblocks = (n+simulator_parallel_grain-1)/simulator_parallel_grain;
+    auto partial = vector<double>(nblocks, 0);
+    parallel_for(nblocks, 1, [&](int start, int end) {
+        for(int block = start; block < end; block ++) partial[block] = body(block*simulator_parallel_grain, min(n,(block+1)*simulator_parallel_grain));
+    });
+    auto sum = 0.0;
+    for(auto p : partial) sum += p;
+    return sum;
+}
+
+/// Updates the simulated data in one backward Euler step, following Baraff and Witkin, "Large Steps in Cloth Simulation":
+/// the velocity change dv solves (M - dt df/dv - dt^2 df/dx) dv = dt (f + dt df/dx v) by preconditioned conjugate gradient,
+/// starting from the previous step solution; spring force derivatives are assembled per spring and applied by gathering
+/// over the particle springs; outside forces are integrated explicitly and pinned particles are filtered out of the solve
+void _simulator_update_step_implicit(ParticleSimulator* simulator, float dt) {
+    auto& particles = simulator->particles;
+    auto n = particles.size();
+
+    // spring forces, and derivatives of the force on the i end wrt the i end; the other derivatives have the same
+    // magnitude (dfdx is clamped to stay negative semi-definite when the spring is compressed)
+    _simulator_springs_update(simulator);
+    if(simulator->_implicit_r.size() != n or simulator->_implicit_spring_k.size() != simulator->springs.size()) _simulator_implicit_resize(simulator);
+    auto& spring_dfdx = simulator->_implicit_spring_dfdx;
+    auto& spring_k = simulator->_implicit_spring_k;
+    parallel_for(simulator->springs.size(), simulator_parallel_grain, [&](int start, int end) {
+        for(int s = start; s < end; s ++) {
+            auto& spring = simulator->springs[s];
+            auto pipj = particles.pos[spring.i] - particles.pos[spring.j];
+            auto l = length(pipj);
+            auto e = pipj / l;
+            auto eet = _outer(e,e);
+            auto dfdx = -spring.ks * (eet + max(0.0f, 1 - spring.l / l) * (identity_mat3f - eet));
+            auto dfdv = -spring.kd * eet;
+            spring_dfdx[s] = dfdx;
+            spring_k[s] = dfdv * dt + dfdx * (dt * dt);
+        }
+    });
+
+    // sum over the springs of particle i of k (x_i - x_other)
+    auto offsets = simulator->_spring_offsets.data();
+    auto adjacency = simulator->_spring_adjacency.data();
+    auto springs = simulator->springs.data();
+    auto nosprings = simulator->springs.empty();
+    auto gather = [&](const vector<mat3f>& k, const vector<vec3f>& x, int i) -> vec3f {
+        auto sum = zero3f;
+        if(nosprings) return sum;
+        for(int a = offsets[i]; a < offsets[i+1]; a++) {
+            auto& spring = springs[adjacency[a]/2];
+            sum += k[adjacency[a]/2] * (x[i] - x[(adjacency[a]%2) ? spring.i : spring.j]);
+        }
+        return sum;
+    };
+    // system matrix times x for particle i (zero for pinned particles)
+    auto system = [&](const vector<vec3f>& x, int i) -> vec3f {
+        return (particles.pinned[i]) ? zero3f : particles.mass[i] * x[i] - gather(spring_k, x, i);
+    };
+
+    // right hand side, jacobi preconditioner and initial residual
+    auto& dv = simulator->_implicit_dv;
+    if(dv.size() != n) dv.assign(n, zero3f);
+    auto& r = simulator->_implicit_r; auto& z = simulator->_implicit_z;
+    auto& p = simulator->_implicit_p; auto& q = simulator->_implicit_q;
+    auto& diag_inv = simulator->_implicit_diag_inv;
+    auto bb = _simulator_parallel_sum(n, [&](int start, int end) -> double {
+        _simulator_particle_forces(simulator, start, end);
+        auto sum = 0.0;
+        for(int i = start; i < end; i++) {
+            if(particles.pinned[i]) { dv[i] = zero3f; r[i] = zero3f; z[i] = zero3f; p[i] = zero3f; diag_inv[i] = zero3f; continue; }
+            auto b = dt * (particles._force[i] + dt * gather(spring_dfdx, particles.vel, i));
+            auto diag = vec3f(particles.mass[i],particles.mass[i],particles.mass[i]);
+            if(not nosprings) {
+                for(int a = offsets[i]; a < offsets[i+1]; a++) {
+                    auto& k = spring_k[adjacency[a]/2];
+                    diag -= vec3f(k.x.x,k.y.y,k.z.z);
+                }
+            }
+            diag_inv[i] = vec3f(1/diag.x,1/diag.y,1/diag.z);
+            r[i] = b - system(dv, i);
+            z[i] = diag_inv[i] * r[i];
+            p[i] = z[i];
+            sum += dot(b, diag_inv[i] * b);
+        }
+        return sum;
+    });
+    auto rz = _simulator_parallel_sum(n, [&](int start, int end) -> double {
+        auto sum = 0.0;
+        for(int i = start; i < end; i++) sum += dot(r[i], z[i]);
+        return sum;
+    });
+
+    // conjugate gradient iterations, until the residual is small relative to the right hand side
+    auto rz_stop = bb * simulator_implicit_tolerance * simulator_implicit_tolerance;
+    for(int iteration = 0; iteration < simulator_implicit_iterations and rz > rz_stop; iteration ++) {
+        auto pq = _simulator_parallel_sum(n, [&](int start, int end) -> double {
+            auto sum = 0.0;
+            for(int i = start; i < end; i++) { q[i] = system(p, i); sum += dot(p[i], q[i]); }
+            return sum;
+        });
+        if(pq <= 0) break;
+        auto alpha = (float)(rz / pq);
+        auto rz_next = _simulator_parallel_sum(n, [&](int start, int end) -> double {
+            auto sum = 0.0;
+            for(int i = start; i < end; i++) {
+                dv[i] += alpha * p[i];
+                r[i] -= alpha * q[i];
+                z[i] = diag_inv[i] * r[i];
+                sum += dot(r[i], z[i]);
+            }
+            return sum;
+        });
+        auto beta = (float)(rz_next / rz);
+        rz = rz_next;
+        parallel_for(n, simulator_parallel_grain, [&](int start, int end) {
+            for(int i = start; i < end; i++) p[i] = z[i] + beta * p[i];
+        });
+    }
+
+    // update velocities and positions handling collisions, then timers
+    auto collide = not simulator->colliders.empty();
+    parallel_for(n, simulator_parallel_grain, [&](int start, int end) {
+        for(int i = start; i < end; i++) {
+            if(particles.pinned[i]) continue;
+            auto prev = particles.pos[i];
+            particles.vel[i] += dv[i];
+            particles.pos[i] += particles.vel[i] * dt;
+            if(collide) _simulator_collide(simulator, i, prev);
+        }
+        for(int i = start; i < end; i++) particles.timer[i] -= dt;
+    });
+    if(simulator->self_collision > 0) _simulator_self_collide(simulator);
+}
+
 /// Updates the simulated data in one step that covers dt seconds by:
 /// 1) computing outside forces (ex: gravity),
 /// 2) applying internal constraints (ex: spring forces),
-/// 3) performing Euler integration,
-/// 4) handling collisions, and
+/// 3) performing Euler integration (explicit, or backward if simulator->implicit),
+/// 4) handling collisions with the colliders and between particles, and
 /// 5) updating timers.
+/// Passes over particles are split in ranges run in parallel.
 /// @param simulator Contains data to update and functions to perform the update
 /// @param dt The number of seconds to advance the simulator (time delta)
 void simulator_update_step(ParticleSimulator* simulator, float dt) {
+    if(simulator->implicit) { _simulator_update_step_implicit(simulator, dt); return; }
 
-    // Initially set forces to 0
-    for(int i = 0; i < simulator->particles.size(); i++)
-        simulator->particles[i]._force = zero3f;
+    auto& particles = simulator->particles;
 
     // Apply internal constraints (for cloth simulation)
     // From graphics.ucsd.edu/courses/cse169_w05/CSE169_16.ppt‎
-    for(int i = 0; i < simulator->springs.size(); i++) {
-        auto pi = simulator->springs[i].i;
-        auto pj = simulator->springs[i].j;
-        auto pipj = simulator->particles[pi].pos - simulator->particles[pj].pos;
-        auto l = length(pipj);
-        auto e = pipj / l;
-        auto v1 = dot(e, simulator->particles[pi].vel);
-        auto v2 = dot(e, simulator->particles[pj].vel);
-        auto fsd = -simulator->springs[i].ks * (l - simulator->springs[i].l) - simulator->springs[i].kd * (v1 - v2);
-        auto f1 = e * fsd;
-        auto f2 = -f1;
-        simulator->particles[pi]._force += f1;
-        simulator->particles[pj]._force += f2;
-    }
+    _simulator_springs_update(simulator);
 
-    // Perform Euler integration; slightly modified to ensure stability of calculation
-    for(int i = 0; i < simulator->particles.size(); i++) {
-        simulator->particles[i]._force += simulator->force(simulator->particles[i]);
+    // the pass captures fit in the function local storage, so that steps do not allocate
+    parallel_for(particles.size(), simulator_parallel_grain, [simulator,dt](int start, int end) {
+        auto& particles = simulator->particles;
+        auto collide = not simulator->colliders.empty();
+        
+        // Gather spring forces and add outside forces
+        _simulator_particle_forces(simulator, start, end);
 
-        if(simulator->particles[i].pinned == false) {
-            auto a = simulator->particles[i]._force/simulator->particles[i].mass;
-            simulator->particles[i].vel += a * dt;
-            simulator->particles[i].pos += simulator->particles[i].vel * dt + (a * dt * dt)/2;
+        // Perform Euler integration; slightly modified to ensure stability of calculation; then handle collisions
+        auto pos = particles.pos.data();
+        auto vel = particles.vel.data();
+        auto force = particles._force.data();
+        auto mass = particles.mass.data();
+        auto pinned = particles.pinned.data();
+        for(int i = start; i < end; i++) {
+            if(pinned[i]) continue;
+            auto a = force[i]/mass[i];
+            auto prev = pos[i];
+            vel[i] += a * dt;
+            pos[i] += vel[i] * dt + (a * dt * dt)/2;
+            if(collide) _simulator_collide(simulator, i, prev);
         }
 
         // Update timers
-        simulator->particles[i].timer -= dt;
-    }
+        auto timer = particles.timer.data();
+        for(int i = start; i < end; i++) timer[i] -= dt;
+    });
+    
+    // Handle self collisions
+    if(simulator->self_collision > 0) _simulator_self_collide(simulator);
 }
 
+void ParticleArrays::reserve(int n) {
+    pos.reserve(n); norm.reserve(n); vel.reserve(n);
+    mass.reserve(n); radius.reserve(n); timer.reserve(n);
+    pinned.reserve(n); oriented.reserve(n); _force.reserve(n);
+    _capacity = n;
+}
+
+int ParticleArrays::spawn(int n) {
+    auto first = size();
+    if(_capacity > 0) n = min(n, _capacity - first);
+    resize(first + max(0,n));
+    return first;
+}
+
+void ParticleArrays::remove_expired() {
+    auto n = size();
+    for(int i = 0; i < n; ) {
+        if(timer[i] > 0) { i ++; continue; }
+        n --;
+        if(i != n) {
+            pos[i] = pos[n]; norm[i] = norm[n]; vel[i] = vel[n];
+            mass[i] = mass[n]; radius[i] = radius[n]; timer[i] = timer[n];
+            pinned[i] = pinned[n]; oriented[i] = oriented[n]; _force[i] = _force[n];
+        }
+    }
+    resize(n);
+}
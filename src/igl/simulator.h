@@ -5,6 +5,8 @@
 #include "common/std.h"
 #include "common/debug.h"
 
+#include "hashgrid.h"
+
 ///@file igl/simulator.h Simulation. @ingroup igl
 ///@defgroup simulator Simulation
 ///@ingroup igl
@@ -12,7 +14,7 @@
 
 struct Shape;
 
-/// Simulated particle
+/// Simulated particle (used to add particles to ParticleArrays)
 struct Particle {
     vec3f   pos = zero3f; ///< position
     vec3f   norm = zero3f; ///< normal
@@ -22,7 +24,58 @@ struct Particle {
     float   timer = 0; ///< timer (when <= 0, the particle is removed)
     bool    pinned = false; ///< whether the particle can move
     bool    oriented = false; ///< whether the particle is an oriented disk
-    vec3f   _force = zero3f; ///< particle force
+};
+
+/// Simulated particles, stored with one array per property (structure of arrays),
+/// so that simulation passes stream through contiguous memory and can be split across threads;
+/// when reserved, the arrays are a fixed capacity pool that particles are spawned into and removed from without allocating
+struct ParticleArrays {
+    vector<vec3f>   pos; ///< positions
+    vector<vec3f>   norm; ///< normals
+    vector<vec3f>   vel; ///< velocities
+    vector<float>   mass; ///< masses
+    vector<float>   radius; ///< radia
+    vector<float>   timer; ///< timers (when <= 0, the particle is removed)
+    vector<char>    pinned; ///< whether the particle can move (not bool, so that threads can write nearby elements)
+    vector<char>    oriented; ///< whether the particle is an oriented disk
+    vector<vec3f>   _force; ///< particle forces
+    
+    int             _capacity = 0; ///< maximum number of particles spawned (0 for no limit)
+    
+    /// number of particles
+    int size() const { return pos.size(); }
+    
+    /// allocate storage for n particles, and limit spawn to n particles
+    void reserve(int n);
+    
+    /// add n particles at the end, set to the Particle defaults, without going over the reserved capacity;
+    /// returns the index of the first new particle (the new particles are the ones from there to size())
+    int spawn(int n);
+    
+    /// resize the arrays, setting new particles to the Particle defaults
+    void resize(int n) {
+        auto p = Particle();
+        pos.resize(n,p.pos); norm.resize(n,p.norm); vel.resize(n,p.vel);
+        mass.resize(n,p.mass); radius.resize(n,p.radius); timer.resize(n,p.timer);
+        pinned.resize(n,p.pinned); oriented.resize(n,p.oriented); _force.resize(n,zero3f);
+    }
+    
+    /// add a particle at the end
+    void push_back(const Particle& p) {
+        pos.push_back(p.pos); norm.push_back(p.norm); vel.push_back(p.vel);
+        mass.push_back(p.mass); radius.push_back(p.radius); timer.push_back(p.timer);
+        pinned.push_back(p.pinned); oriented.push_back(p.oriented); _force.push_back(zero3f);
+    }
+    
+    /// set particle i
+    void set(int i, const Particle& p) {
+        pos[i] = p.pos; norm[i] = p.norm; vel[i] = p.vel;
+        mass[i] = p.mass; radius[i] = p.radius; timer[i] = p.timer;
+        pinned[i] = p.pinned; oriented[i] = p.oriented; _force[i] = zero3f;
+    }
+    
+    /// remove the particles whose timer expired, moving the last particles in their place (changes the order)
+    void remove_expired();
 };
 
 /// Spring between two particles
@@ -37,28 +90,90 @@ struct ParticleSpring {
 /// Particle collision object
 struct ParticleCollider {
     Shape*   shape = nullptr; ///< collider shape
-    frame3f  frame; ///< collider frame
+    frame3f  frame; ///< collider frame (in particle coordinates)
+    
+    range3f  _bounds; ///< collider bounds in particle coordinates (set by simulator_colliders_init)
+};
+
+/// External forces on the particles, evaluated inline by the simulator: gravity, and drag toward the wind velocity
+struct ParticleForces {
+    vec3f   gravity = zero3f; ///< gravity acceleration
+    vec3f   wind = zero3f; ///< wind velocity
+    float   airfriction = 0; ///< drag coefficient (force per unit of velocity relative to the wind)
+};
+
+/// Simulation step statistics, accumulated over updates (reset them to count again)
+struct ParticleSimulatorStats {
+    int     updates = 0; ///< updates
+    int     steps = 0; ///< steps taken
+    int     steps_fixed = 0; ///< steps that steps_per_sec would have taken
+    int     update_steps = 0; ///< steps taken by the last update
+    float   step_min = 0; ///< shortest step taken (0 before the first step)
+    float   step_max = 0; ///< longest step taken
 };
 
 /// Particle simulator
 struct ParticleSimulator {
-    vector<Particle>                    particles; ///< list of particles
+    ParticleArrays                      particles; ///< particles
     vector<ParticleSpring>              springs; ///< list of springs
     vector<ParticleCollider>            colliders; ///< list of collision objects
     
-    function<vec3f (const Particle&)>   force; ///< function that evaluates the force
+    ParticleForces                      forces; ///< external forces
+    /// function that adds other external forces to particles [start,end) in particles._force (empty for none)
+    /// (called once per range of particles, possibly from multiple threads at once)
+    function<void (ParticleArrays&, int, int)> force;
     
     function<void (float)>              begin_update = [](float){}; ///< function called at the start of each simulation update
-    function<void (float)>              end_update = [](float){}; ///< function called at the end of each simulation update
-    function<void (float)>              begin_step = [](float){}; ///< function called at the start of each simulation step
-    function<void (float)>              end_step = [](float){}; ///< function called at the end of each simulation step
+    function<void (float)>              end_update = [](float){}; ///< function called at the end of each simulation update (stats include the update)
+    function<void (float)>              begin_step; ///< function called at the start of each simulation step (empty for none; prefer update functions)
+    function<void (float)>              end_step; ///< function called at the end of each simulation step (empty for none; prefer update functions)
     
-    int                                 steps_per_sec = 1000; ///< simulation steps per second
+    int                                 steps_per_sec = 1000; ///< simulation steps per second (the maximum when adaptive)
+    bool                                adaptive = false; ///< whether to take the fewest steps within the stability limits of the particle motion and springs
+    float                               adaptive_cfl = 0.5; ///< fraction of the stability limits taken by adaptive steps
+    float                               adaptive_tolerance = 0.01; ///< position error allowed per adaptive step, relative to the particle radius
+    bool                                implicit = false; ///< whether to integrate springs with backward Euler (stable for stiff springs at few steps)
+    float                               collision_dumping = 0.5; ///< fraction of the normal velocity bounced back by collisions
+    float                               collision_friction = 0.5; ///< friction coefficient of collisions
+    float                               self_collision = 0; ///< distance below which particles not connected by a spring are pushed apart (0 to disable)
+    
+    ParticleSimulatorStats              stats; ///< step statistics
+    
+    vector<int>                         _spring_offsets; ///< per particle range of _spring_adjacency (compressed sparse rows)
+    vector<int>                         _spring_adjacency; ///< springs of each particle, as 2*spring index plus 1 for the j end
+    vector<vec3f>                       _spring_force; ///< force of each spring on its i end
+    float                               _spring_dt = 0; ///< longest stable explicit step of the springs (0 for no springs)
+    float                               _stable_dt = 0; ///< longest stable step (reduced over the particles by adaptive updates)
+    vector<vec3f>                       _implicit_dv; ///< velocity change of the last implicit step (initial guess for the next)
+    vector<mat3f>                       _implicit_spring_dfdx; ///< implicit step spring force derivatives wrt position (scratch)
+    vector<mat3f>                       _implicit_spring_k; ///< implicit step spring system matrix blocks (scratch)
+    vector<vec3f>                       _implicit_r; ///< implicit step conjugate gradient residual (scratch)
+    vector<vec3f>                       _implicit_z; ///< implicit step preconditioned residual (scratch)
+    vector<vec3f>                       _implicit_p; ///< implicit step search direction (scratch)
+    vector<vec3f>                       _implicit_q; ///< implicit step system matrix times search direction (scratch)
+    vector<vec3f>                       _implicit_diag_inv; ///< implicit step jacobi preconditioner (scratch)
+    HashGrid                            _grid; ///< particle neighbor grid (rebuilt at each step by self collision)
+    vector<vec3f>                       _self_collision_dpos; ///< position change of each particle from self collision
+    vector<vec3f>                       _self_collision_dvel; ///< velocity change of each particle from self collision
 };
 
+///@name simulation parameters
+///@{
+const int simulator_parallel_grain = 4096; ///< particles below which a pass is not split across threads
+const int simulator_implicit_iterations = 100; ///< maximum conjugate gradient iterations of an implicit step
+const float simulator_implicit_tolerance = 1e-3f; ///< conjugate gradient relative residual that ends an implicit step
+///@}
+
 ///@name simulation interface
 ///@{
+/// build the particle to spring adjacency used to gather spring forces (call after changing springs or particle count)
+void simulator_springs_init(ParticleSimulator* simulator);
+/// compute the collider bounds and build their shape acceleration structures (call after changing colliders)
+void simulator_colliders_init(ParticleSimulator* simulator);
+/// advance the simulation by dt, in steps_per_sec steps, or in as few as stable if adaptive
 void simulator_update(ParticleSimulator* simulator, float dt);
+/// longest step, up to max_dt, within the adaptive stability limits
+float simulator_stable_dt(ParticleSimulator* simulator, float max_dt);
 void simulator_update_step(ParticleSimulator* simulator, float dt);
 ///@}
 
@@ -1,5 +1,9 @@
 #include "tesselate.h"
 
+#include "common/parallel.h"
+
+#include <atomic>
+
 ///@file igl/tesselate.cpp Tesselation. @ingroup igl
 
 Shape* _tesselate_shape_uniform(const function<frame3f (const vec2f&)> shape_frame,
@@ -654,11 +658,68 @@ Shape* tesselate_shape(Shape* shape, int level, bool smooth) {
     else { not_implemented_error(); return nullptr; }
 }
 
+/// build states of a tesselation level
+enum { _tesselation_build_queued = 0, _tesselation_build_done = 1, _tesselation_build_abandoned = 2 };
+
+/// tesselation level built on the background thread; released by the levels when claiming the result,
+/// or by the background thread if the levels were released first
+struct _TesselationBuild {
+    Shape*                  source = nullptr; ///< copy of the shape (so that the shape may change while building)
+    int                     level = 0; ///< level
+    bool                    smooth = true; ///< tesselation smooth frames
+    Shape*                  tesselation = nullptr; ///< tesselation built
+    std::atomic<int>        state; ///< build state
+};
+
+/// build a level (on the background thread)
+void _tesselation_build(_TesselationBuild* build) {
+    if(build->state != _tesselation_build_abandoned) build->tesselation = tesselate_shape(build->source, build->level, build->smooth);
+    delete build->source;
+    auto queued = (int)_tesselation_build_queued;
+    if(build->state.compare_exchange_strong(queued, _tesselation_build_done)) return;
+    if(build->tesselation) delete build->tesselation;
+    delete build;
+}
+
+TesselationLevels::~TesselationLevels() {
+    for(auto tesselation : levels) if(tesselation) delete tesselation;
+    for(auto build : _builds) {
+        if(not build) continue;
+        auto queued = (int)_tesselation_build_queued;
+        if(build->state.compare_exchange_strong(queued, _tesselation_build_abandoned)) continue;
+        delete build->tesselation;
+        delete build;
+    }
+}
+
+/// levels of detail of a shape whose full detail is at level (null for shapes without them)
+TesselationLevels* _tesselation_levels_init(Shape* shape, int level, bool smooth) {
+    auto segments = 0.0f;
+    if(is<CatmullClarkSubdiv>(shape)) segments = sqrt((float)cast<CatmullClarkSubdiv>(shape)->quad.size());
+    else if(is<Subdiv>(shape)) segments = sqrt((float)(cast<Subdiv>(shape)->triangle.size()+cast<Subdiv>(shape)->quad.size()));
+    else if(is<Spline>(shape)) segments = cast<Spline>(shape)->cubic.size()*pow2(2);
+    else if(is<Patch>(shape)) {
+        auto patch = cast<Patch>(shape);
+        if(patch->continous_stride > 0) segments = max(patch->continous_stride,(int)patch->cubic.size()/patch->continous_stride)*pow2(2);
+    }
+    else if(is<Sphere>(shape) or is<Cylinder>(shape)) segments = pow2(2);
+    if(level <= 0 or segments <= 0) return nullptr;
+    auto levels = new TesselationLevels();
+    levels->level = level;
+    levels->smooth = smooth;
+    levels->segments = segments;
+    levels->levels.assign(level, nullptr);
+    levels->_builds.assign(level, nullptr);
+    return levels;
+}
+
 void shape_tesselation_init(Shape* shape, bool override, int override_level, bool override_smooth) {
     if(shape->_tesselation) { delete shape->_tesselation; shape->_tesselation = nullptr; }
+    if(shape->_levels) { delete shape->_levels; shape->_levels = nullptr; }
     
     if(override) {
         shape->_tesselation = tesselate_shape(shape, override_level, override_smooth);
+        shape->_levels = _tesselation_levels_init(shape, override_level, override_smooth);
         return;
     }
     
@@ -669,6 +730,51 @@ void shape_tesselation_init(Shape* shape, bool override, int override_level, boo
     else if(is<TesselationOverride>(shape)) shape->_tesselation = tesselate_shape(shape, cast<TesselationOverride>(shape)->level, cast<TesselationOverride>(shape)->smooth);
     else if(is<DeformedShape>(shape)) shape->_tesselation = tesselate_shape(shape, cast<DeformedShape>(shape)->level, cast<DeformedShape>(shape)->smooth);
     else { }
+    
+    // spheres and cylinders are not tesselated, but drawn at the detail of their full level
+    if(is<CatmullClarkSubdiv>(shape)) shape->_levels = _tesselation_levels_init(shape, cast<CatmullClarkSubdiv>(shape)->level, cast<CatmullClarkSubdiv>(shape)->smooth);
+    else if(is<Subdiv>(shape)) shape->_levels = _tesselation_levels_init(shape, cast<Subdiv>(shape)->level, cast<Subdiv>(shape)->smooth);
+    else if(is<Spline>(shape)) shape->_levels = _tesselation_levels_init(shape, cast<Spline>(shape)->level, cast<Spline>(shape)->smooth);
+    else if(is<Patch>(shape)) shape->_levels = _tesselation_levels_init(shape, cast<Patch>(shape)->level, cast<Patch>(shape)->smooth);
+    else if(is<Sphere>(shape) or is<Cylinder>(shape)) shape->_levels = _tesselation_levels_init(shape, tesselation_lod_analytic_level, true);
+    else { }
+}
+
+int shape_tesselation_lod_level(Shape* shape, float pixels, float edge_pixels) {
+    auto levels = shape->_levels;
+    if(not levels) return 0;
+    // each level halves the edges, starting from segments edges across the shape
+    if(not (pixels < edge_pixels*levels->segments*pow2(levels->level))) return levels->level;
+    if(pixels <= edge_pixels*levels->segments) return 0;
+    return clamp((int)ceil(log2(pixels/(edge_pixels*levels->segments))), 0, levels->level);
+}
+
+Shape* shape_tesselation_lod(Shape* shape, int level) {
+    auto levels = shape->_levels;
+    if(not levels or level >= levels->level) return shape;
+    level = max(level, 0);
+    
+    // claim the levels built since the last call
+    for(int l = level; l < levels->level; l ++) {
+        auto build = levels->_builds[l];
+        if(not build or build->state != _tesselation_build_done) continue;
+        levels->levels[l] = build->tesselation;
+        levels->_builds[l] = nullptr;
+        delete build;
+    }
+    
+    if(not levels->levels[level] and not levels->_builds[level]) {
+        auto build = new _TesselationBuild();
+        build->source = shape_clone(shape);
+        build->level = level;
+        build->smooth = levels->smooth;
+        build->state = _tesselation_build_queued;
+        levels->_builds[level] = build;
+        parallel_background([build](){ _tesselation_build(build); });
+    }
+    
+    for(int l = level; l < levels->level; l ++) if(levels->levels[l]) return levels->levels[l];
+    return shape;
 }
 
 void primitive_tesselation_init(Primitive* prim, bool override, int override_level, bool override_smooth) {
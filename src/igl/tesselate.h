@@ -42,6 +42,26 @@ struct EdgeHashTable {
     }
 };
 
+struct _TesselationBuild;
+
+/// Tesselations of a shape at the levels below the one of its full detail tesselation, to draw it with less
+/// detail when small on screen; each level is built on the background thread when first requested
+struct TesselationLevels {
+    int                         level = 0; ///< level of the full detail tesselation
+    bool                        smooth = true; ///< tesselation smooth frames
+    float                       segments = 1; ///< tesselation segments across the shape at level 0 (doubled at each level)
+    vector<Shape*>              levels; ///< tesselation at each level below the full one (null if not built yet)
+    vector<_TesselationBuild*>  _builds; ///< build of each level in progress (null if none)
+
+    /// Destructor (releases the levels built, while the builds in progress are released once done)
+    ~TesselationLevels();
+};
+
+///@name tesselation level of detail parameters
+///@{
+const int tesselation_lod_analytic_level = 4; ///< full detail level of spheres and cylinders (matching the segments they are drawn with)
+///@}
+
 ///@name shape tesselate interface
 ///@{
 Shape* tesselate_shape(Shape* shape, int level, bool smooth);
@@ -51,10 +71,22 @@ Shape* tesselate_shape(Shape* shape, int level, bool smooth);
 ///@{
 void primitive_tesselation_init(Primitive* prim, bool override = false, int override_level = 0, bool override_smooth = false);
 void primitives_tesselation_init(PrimitiveGroup* prim, bool override = false, int override_level = 0, bool override_smooth = false);
+/// tesselate the shape, if needed, and reset its coarser levels of detail (kept for subdivision surfaces, splines, patches,
+/// spheres and cylinders)
 void shape_tesselation_init(Shape* shape, bool override = false, int override_level = 0, bool override_smooth = false);
 void scene_tesselation_init(Scene* scene, bool override = false, int override_level = 0, bool override_smooth = false);
 ///@}
 
+///@name tesselation level of detail interface
+///@{
+/// coarsest level of detail of the shape with tesselation edges of at most edge_pixels, when the shape spans pixels on screen
+/// (0 for shapes without levels of detail)
+int shape_tesselation_lod_level(Shape* shape, float pixels, float edge_pixels);
+/// shape to draw at level: the tesselation at that level if built, otherwise the closest finer one built, otherwise
+/// the shape itself (for its full detail); levels not built are queued on the background thread (call from one thread)
+Shape* shape_tesselation_lod(Shape* shape, int level);
+///@}
+
 ///@}
 
 #endif
\ No newline at end of file
@@ -1,5 +1,15 @@
 #include "geom.h"
 
+#if defined(__SSE2__) || defined(_M_X64)
+#define GEOM_SIMD_SSE 1
+#include <emmintrin.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define GEOM_SIMD_AVX2 1
+#include <immintrin.h>
+#endif
+
 ///@file vmath/geom.cpp Geometric math. @ingroup vmath
 
 // from pbrt
@@ -38,6 +48,251 @@ bool intersect_triangle(const ray3f& ray,
     return true;
 }
 
+/// scalar version of intersect_triangles8 (fallback)
+int _intersect_triangles8_scalar(const ray3f& ray, const triangles8f& tr, int n, float* t, float* ba, float* bb) {
+    int mask = 0;
+    for(int l = 0; l < n; l ++) {
+        auto v0 = vec3f(tr.v0[0][l],tr.v0[1][l],tr.v0[2][l]);
+        auto v1 = vec3f(tr.v1[0][l],tr.v1[1][l],tr.v1[2][l]);
+        auto v2 = vec3f(tr.v2[0][l],tr.v2[1][l],tr.v2[2][l]);
+        if(intersect_triangle(ray, v0, v1, v2, t[l], ba[l], bb[l])) mask |= 1 << l;
+    }
+    return mask;
+}
+
+/// scalar version of intersect_bboxes8 (fallback)
+int _intersect_bboxes8_scalar(const ray3f& ray, const vec3f& ray_dinv, const bboxes8f& bb, int n, float* t0) {
+    int mask = 0;
+    for(int l = 0; l < n; l ++) {
+        auto tmin = ray.tmin, tmax = ray.tmax;
+        for(int i = 0; i < 3; i ++) {
+            auto tnear = (bb.min[i][l] - ray.e[i]) * ray_dinv[i];
+            auto tfar  = (bb.max[i][l] - ray.e[i]) * ray_dinv[i];
+            if(tnear > tfar) std::swap(tnear, tfar);
+            tfar *= 1.0000004f;
+            tmin = tnear > tmin ? tnear : tmin;
+            tmax = tfar  < tmax ? tfar  : tmax;
+        }
+        if(tmin <= tmax) { mask |= 1 << l; t0[l] = tmin; }
+    }
+    return mask;
+}
+
+#ifdef GEOM_SIMD_SSE
+/// SSE version of intersect_triangles8: two groups of 4 lanes, same arithmetic as intersect_triangle
+int _intersect_triangles8_sse(const ray3f& ray, const triangles8f& tr, int n, float* t, float* ba, float* bb) {
+    auto ix = _mm_set1_ps(ray.d.x), iy = _mm_set1_ps(ray.d.y), iz = _mm_set1_ps(ray.d.z);
+    auto ex_ = _mm_set1_ps(ray.e.x), ey_ = _mm_set1_ps(ray.e.y), ez_ = _mm_set1_ps(ray.e.z);
+    auto tmin = _mm_set1_ps(ray.tmin), tmax = _mm_set1_ps(ray.tmax);
+    auto zero = _mm_setzero_ps(), one = _mm_set1_ps(1);
+    int mask = 0;
+    for(int h = 0; h < n; h += 4) {
+        auto v2x = _mm_loadu_ps(tr.v2[0]+h), v2y = _mm_loadu_ps(tr.v2[1]+h), v2z = _mm_loadu_ps(tr.v2[2]+h);
+        auto ax = _mm_sub_ps(_mm_loadu_ps(tr.v0[0]+h),v2x), ay = _mm_sub_ps(_mm_loadu_ps(tr.v0[1]+h),v2y), az = _mm_sub_ps(_mm_loadu_ps(tr.v0[2]+h),v2z);
+        auto bx = _mm_sub_ps(_mm_loadu_ps(tr.v1[0]+h),v2x), by = _mm_sub_ps(_mm_loadu_ps(tr.v1[1]+h),v2y), bz = _mm_sub_ps(_mm_loadu_ps(tr.v1[2]+h),v2z);
+        auto ex = _mm_sub_ps(ex_,v2x), ey = _mm_sub_ps(ey_,v2y), ez = _mm_sub_ps(ez_,v2z);
+        // c1 = cross(i,b), d = dot(c1,a)
+        auto c1x = _mm_sub_ps(_mm_mul_ps(iy,bz),_mm_mul_ps(iz,by));
+        auto c1y = _mm_sub_ps(_mm_mul_ps(iz,bx),_mm_mul_ps(ix,bz));
+        auto c1z = _mm_sub_ps(_mm_mul_ps(ix,by),_mm_mul_ps(iy,bx));
+        auto d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c1x,ax),_mm_mul_ps(c1y,ay)),_mm_mul_ps(c1z,az));
+        // c2 = cross(e,a), t = dot(c2,b) / d
+        auto c2x = _mm_sub_ps(_mm_mul_ps(ey,az),_mm_mul_ps(ez,ay));
+        auto c2y = _mm_sub_ps(_mm_mul_ps(ez,ax),_mm_mul_ps(ex,az));
+        auto c2z = _mm_sub_ps(_mm_mul_ps(ex,ay),_mm_mul_ps(ey,ax));
+        auto lt = _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(c2x,bx),_mm_mul_ps(c2y,by)),_mm_mul_ps(c2z,bz)),d);
+        // ba = dot(c1,e) / d, bb = dot(cross(a,i),e) / d
+        auto lba = _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(c1x,ex),_mm_mul_ps(c1y,ey)),_mm_mul_ps(c1z,ez)),d);
+        auto c3x = _mm_sub_ps(_mm_mul_ps(ay,iz),_mm_mul_ps(az,iy));
+        auto c3y = _mm_sub_ps(_mm_mul_ps(az,ix),_mm_mul_ps(ax,iz));
+        auto c3z = _mm_sub_ps(_mm_mul_ps(ax,iy),_mm_mul_ps(ay,ix));
+        auto lbb = _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(c3x,ex),_mm_mul_ps(c3y,ey)),_mm_mul_ps(c3z,ez)),d);
+        auto hit = _mm_and_ps(_mm_cmpneq_ps(d,zero),_mm_and_ps(_mm_cmpge_ps(lt,tmin),_mm_cmple_ps(lt,tmax)));
+        hit = _mm_and_ps(hit,_mm_and_ps(_mm_cmpge_ps(lba,zero),_mm_cmpge_ps(lbb,zero)));
+        hit = _mm_and_ps(hit,_mm_cmple_ps(_mm_add_ps(lba,lbb),one));
+        float st[4], sba[4], sbb[4];
+        _mm_storeu_ps(st,lt); _mm_storeu_ps(sba,lba); _mm_storeu_ps(sbb,lbb);
+        auto hmask = _mm_movemask_ps(hit);
+        for(int l = 0; l < 4 and h+l < n; l ++) {
+            if(not (hmask & (1 << l))) continue;
+            mask |= 1 << (h+l); t[h+l] = st[l]; ba[h+l] = sba[l]; bb[h+l] = sbb[l];
+        }
+    }
+    return mask;
+}
+
+/// SSE version of intersect_bboxes8: two groups of 4 lanes
+int _intersect_bboxes8_sse(const ray3f& ray, const vec3f& ray_dinv, const bboxes8f& bb, int n, float* t0) {
+    auto pad = _mm_set1_ps(1.0000004f);
+    int mask = 0;
+    for(int h = 0; h < n; h += 4) {
+        auto tmin = _mm_set1_ps(ray.tmin), tmax = _mm_set1_ps(ray.tmax);
+        for(int i = 0; i < 3; i ++) {
+            auto e = _mm_set1_ps(ray.e[i]), dinv = _mm_set1_ps(ray_dinv[i]);
+            auto ta = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(bb.min[i]+h),e),dinv);
+            auto tb = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(bb.max[i]+h),e),dinv);
+            // min/max return their second operand when either is NaN (ray in a slab plane), so the operands are
+            // ordered to pick the same values as the compare and swap of the scalar code: tnear is ta unless tb < ta,
+            // tfar is tb unless ta > tb, and NaN values never replace the current interval
+            auto tnear = _mm_min_ps(tb,ta), tfar = _mm_max_ps(ta,tb);
+            tmin = _mm_max_ps(tnear,tmin);
+            tmax = _mm_min_ps(_mm_mul_ps(tfar,pad),tmax);
+        }
+        float st[4];
+        _mm_storeu_ps(st,tmin);
+        auto hmask = _mm_movemask_ps(_mm_cmple_ps(tmin,tmax));
+        for(int l = 0; l < 4 and h+l < n; l ++) {
+            if(not (hmask & (1 << l))) continue;
+            mask |= 1 << (h+l); t0[h+l] = st[l];
+        }
+    }
+    return mask;
+}
+#endif
+
+#ifdef GEOM_SIMD_AVX2
+/// AVX2 version of intersect_triangles8: all 8 lanes at once, same arithmetic as intersect_triangle
+__attribute__((target("avx2"))) int _intersect_triangles8_avx2(const ray3f& ray, const triangles8f& tr, int n, float* t, float* ba, float* bb) {
+    auto ix = _mm256_set1_ps(ray.d.x), iy = _mm256_set1_ps(ray.d.y), iz = _mm256_set1_ps(ray.d.z);
+    auto v2x = _mm256_loadu_ps(tr.v2[0]), v2y = _mm256_loadu_ps(tr.v2[1]), v2z = _mm256_loadu_ps(tr.v2[2]);
+    auto ax = _mm256_sub_ps(_mm256_loadu_ps(tr.v0[0]),v2x), ay = _mm256_sub_ps(_mm256_loadu_ps(tr.v0[1]),v2y), az = _mm256_sub_ps(_mm256_loadu_ps(tr.v0[2]),v2z);
+    auto bx = _mm256_sub_ps(_mm256_loadu_ps(tr.v1[0]),v2x), by = _mm256_sub_ps(_mm256_loadu_ps(tr.v1[1]),v2y), bz = _mm256_sub_ps(_mm256_loadu_ps(tr.v1[2]),v2z);
+    auto ex = _mm256_sub_ps(_mm256_set1_ps(ray.e.x),v2x), ey = _mm256_sub_ps(_mm256_set1_ps(ray.e.y),v2y), ez = _mm256_sub_ps(_mm256_set1_ps(ray.e.z),v2z);
+    // c1 = cross(i,b), d = dot(c1,a)
+    auto c1x = _mm256_sub_ps(_mm256_mul_ps(iy,bz),_mm256_mul_ps(iz,by));
+    auto c1y = _mm256_sub_ps(_mm256_mul_ps(iz,bx),_mm256_mul_ps(ix,bz));
+    auto c1z = _mm256_sub_ps(_mm256_mul_ps(ix,by),_mm256_mul_ps(iy,bx));
+    auto d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c1x,ax),_mm256_mul_ps(c1y,ay)),_mm256_mul_ps(c1z,az));
+    // c2 = cross(e,a), t = dot(c2,b) / d
+    auto c2x = _mm256_sub_ps(_mm256_mul_ps(ey,az),_mm256_mul_ps(ez,ay));
+    auto c2y = _mm256_sub_ps(_mm256_mul_ps(ez,ax),_mm256_mul_ps(ex,az));
+    auto c2z = _mm256_sub_ps(_mm256_mul_ps(ex,ay),_mm256_mul_ps(ey,ax));
+    auto lt = _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c2x,bx),_mm256_mul_ps(c2y,by)),_mm256_mul_ps(c2z,bz)),d);
+    // ba = dot(c1,e) / d, bb = dot(cross(a,i),e) / d
+    auto lba = _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c1x,ex),_mm256_mul_ps(c1y,ey)),_mm256_mul_ps(c1z,ez)),d);
+    auto c3x = _mm256_sub_ps(_mm256_mul_ps(ay,iz),_mm256_mul_ps(az,iy));
+    auto c3y = _mm256_sub_ps(_mm256_mul_ps(az,ix),_mm256_mul_ps(ax,iz));
+    auto c3z = _mm256_sub_ps(_mm256_mul_ps(ax,iy),_mm256_mul_ps(ay,ix));
+    auto lbb = _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c3x,ex),_mm256_mul_ps(c3y,ey)),_mm256_mul_ps(c3z,ez)),d);
+    auto zero = _mm256_setzero_ps();
+    auto hit = _mm256_and_ps(_mm256_cmp_ps(d,zero,_CMP_NEQ_OQ),_mm256_and_ps(_mm256_cmp_ps(lt,_mm256_set1_ps(ray.tmin),_CMP_GE_OQ),_mm256_cmp_ps(lt,_mm256_set1_ps(ray.tmax),_CMP_LE_OQ)));
+    hit = _mm256_and_ps(hit,_mm256_and_ps(_mm256_cmp_ps(lba,zero,_CMP_GE_OQ),_mm256_cmp_ps(lbb,zero,_CMP_GE_OQ)));
+    hit = _mm256_and_ps(hit,_mm256_cmp_ps(_mm256_add_ps(lba,lbb),_mm256_set1_ps(1),_CMP_LE_OQ));
+    float st[8], sba[8], sbb[8];
+    _mm256_storeu_ps(st,lt); _mm256_storeu_ps(sba,lba); _mm256_storeu_ps(sbb,lbb);
+    auto mask = _mm256_movemask_ps(hit) & ((1 << n) - 1);
+    for(int l = 0; l < n; l ++) {
+        if(not (mask & (1 << l))) continue;
+        t[l] = st[l]; ba[l] = sba[l]; bb[l] = sbb[l];
+    }
+    // clear the upper halves of the registers: the compiler does not always do it, and the callers run SSE code
+    _mm256_zeroupper();
+    return mask;
+}
+
+/// AVX2 version of intersect_bboxes8: all 8 lanes at once
+__attribute__((target("avx2"))) int _intersect_bboxes8_avx2(const ray3f& ray, const vec3f& ray_dinv, const bboxes8f& bb, int n, float* t0) {
+    auto tmin = _mm256_set1_ps(ray.tmin), tmax = _mm256_set1_ps(ray.tmax);
+    auto pad = _mm256_set1_ps(1.0000004f);
+    for(int i = 0; i < 3; i ++) {
+        auto e = _mm256_set1_ps(ray.e[i]), dinv = _mm256_set1_ps(ray_dinv[i]);
+        auto ta = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(bb.min[i]),e),dinv);
+        auto tb = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(bb.max[i]),e),dinv);
+        // operands ordered as in the SSE version, to match the scalar code for NaN slabs
+        auto tnear = _mm256_min_ps(tb,ta), tfar = _mm256_max_ps(ta,tb);
+        tmin = _mm256_max_ps(tnear,tmin);
+        tmax = _mm256_min_ps(_mm256_mul_ps(tfar,pad),tmax);
+    }
+    float st[8];
+    _mm256_storeu_ps(st,tmin);
+    auto mask = _mm256_movemask_ps(_mm256_cmp_ps(tmin,tmax,_CMP_LE_OQ)) & ((1 << n) - 1);
+    for(int l = 0; l < n; l ++) if(mask & (1 << l)) t0[l] = st[l];
+    _mm256_zeroupper();
+    return mask;
+}
+#endif
+
+/// kernels of a given width
+int _intersect_triangles8(int width, const ray3f& ray, const triangles8f& triangles, int n, float* t, float* ba, float* bb) {
+    switch(width) {
+#ifdef GEOM_SIMD_AVX2
+        case 8: return _intersect_triangles8_avx2(ray, triangles, n, t, ba, bb);
+#endif
+#ifdef GEOM_SIMD_SSE
+        case 4: return _intersect_triangles8_sse(ray, triangles, n, t, ba, bb);
+#endif
+        default: return _intersect_triangles8_scalar(ray, triangles, n, t, ba, bb);
+    }
+}
+
+/// kernels of a given width
+int _intersect_bboxes8(int width, const ray3f& ray, const vec3f& ray_dinv, const bboxes8f& bboxes, int n, float* t0) {
+    switch(width) {
+#ifdef GEOM_SIMD_AVX2
+        case 8: return _intersect_bboxes8_avx2(ray, ray_dinv, bboxes, n, t0);
+#endif
+#ifdef GEOM_SIMD_SSE
+        case 4: return _intersect_bboxes8_sse(ray, ray_dinv, bboxes, n, t0);
+#endif
+        default: return _intersect_bboxes8_scalar(ray, ray_dinv, bboxes, n, t0);
+    }
+}
+
+/// check the kernels of a given width against the scalar ones, with rays lying in the planes of the box slabs
+/// and of the triangles (where the arithmetic produces NaN values) as well as crossing them
+bool _intersect_simd_check(int width) {
+    bboxes8f bboxes; triangles8f triangles;
+    for(int l = 0; l < 8; l ++) {
+        for(int i = 0; i < 3; i ++) {
+            bboxes.min[i][l] = -1 + 0.25f * ((l+i) % 3);
+            bboxes.max[i][l] = bboxes.min[i][l] + 0.5f + 0.25f * (l % 2);
+            triangles.v0[i][l] = bboxes.min[i][l];
+            triangles.v1[i][l] = (i == l % 3) ? bboxes.max[i][l] : bboxes.min[i][l];
+            triangles.v2[i][l] = (i == (l+1) % 3) ? bboxes.max[i][l] : bboxes.min[i][l];
+        }
+    }
+    const float coords[] = { -1, -0.75f, -0.5f, 0, 0.25f };
+    const vec3f dirs[] = { x3f, -y3f, z3f, normalize(vec3f(1,1,0)), normalize(vec3f(0,-1,1)), normalize(vec3f(1,-2,3)) };
+    for(auto x : coords) for(auto y : coords) for(auto z : coords) for(auto d : dirs) {
+        // components along a zero direction stay on the grid, so the ray runs inside slab planes
+        auto ray = ray3f(vec3f(x,y,z) - d * 2, d);
+        auto ray_dinv = vec3f(1/d.x,1/d.y,1/d.z);
+        for(int n = 1; n <= 8; n += 3) {
+            float t0[8], t0_scalar[8], t[8], ba[8], bb[8], t_scalar[8], ba_scalar[8], bb_scalar[8];
+            if(_intersect_bboxes8(width, ray, ray_dinv, bboxes, n, t0) != _intersect_bboxes8_scalar(ray, ray_dinv, bboxes, n, t0_scalar)) return false;
+            if(_intersect_triangles8(width, ray, triangles, n, t, ba, bb) != _intersect_triangles8_scalar(ray, triangles, n, t_scalar, ba_scalar, bb_scalar)) return false;
+        }
+    }
+    return true;
+}
+
+/// select the widest kernels supported by the running cpu that agree with the scalar ones
+int _intersect_simd_width_detect() {
+    int width = 1;
+#ifdef GEOM_SIMD_SSE
+    width = 4;
+#endif
+#ifdef GEOM_SIMD_AVX2
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) width = 8;
+#endif
+    while(width > 1 and not _intersect_simd_check(width)) width = (width == 8) ? 4 : 1;
+    return width;
+}
+
+int intersect_simd_width() {
+    static const int width = _intersect_simd_width_detect();
+    return width;
+}
+
+int intersect_triangles8(const ray3f& ray, const triangles8f& triangles, int n, float* t, float* ba, float* bb) {
+    return _intersect_triangles8(intersect_simd_width(), ray, triangles, n, t, ba, bb);
+}
+
+int intersect_bboxes8(const ray3f& ray, const vec3f& ray_dinv, const bboxes8f& bboxes, int n, float* t0) {
+    return _intersect_bboxes8(intersect_simd_width(), ray, ray_dinv, bboxes, n, t0);
+}
+
 bool intersect_sphere(const ray3f& ray, const vec3f& o, float r, float& t) {
     auto a = lengthSqr(ray.d);
     auto b = 2*dot(ray.d,ray.e-o);
@@ -92,6 +347,27 @@ bool intersect_quad(const ray3f& ray, float w, float h, float& t, float& ba, flo
     return true;
 }
 
+// Ericson, Real-Time Collision Detection, 5.1.5: test the vertex and edge regions, then project on the face
+vec3f closest_point_triangle(const vec3f& p, const vec3f& v0, const vec3f& v1, const vec3f& v2) {
+    auto ab = v1 - v0, ac = v2 - v0, ap = p - v0;
+    auto d1 = dot(ab,ap), d2 = dot(ac,ap);
+    if(d1 <= 0 and d2 <= 0) return v0;
+    auto bp = p - v1;
+    auto d3 = dot(ab,bp), d4 = dot(ac,bp);
+    if(d3 >= 0 and d4 <= d3) return v1;
+    auto vc = d1*d4 - d3*d2;
+    if(vc <= 0 and d1 >= 0 and d3 <= 0) return v0 + ab * (d1 / (d1 - d3));
+    auto cp = p - v2;
+    auto d5 = dot(ab,cp), d6 = dot(ac,cp);
+    if(d6 >= 0 and d5 <= d6) return v2;
+    auto vb = d5*d2 - d1*d6;
+    if(vb <= 0 and d2 >= 0 and d6 <= 0) return v0 + ac * (d2 / (d2 - d6));
+    auto va = d3*d6 - d5*d4;
+    if(va <= 0 and (d4 - d3) >= 0 and (d5 - d6) >= 0) return v1 + (v2 - v1) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    auto denom = 1 / (va + vb + vc);
+    return v0 + ab * (vb * denom) + ac * (vc * denom);
+}
+
 // http://geomalgorithms.com/a02-_lines.html
 //    distance( Point P,  Segment P0:P1 )
 //    {
@@ -42,6 +42,7 @@ inline vec3f quad_normal(const vec3f& v0, const vec3f& v1, const vec3f& v2, cons
 ///@name volume
 ///@{
 inline float sphere_area(float r) { return 4*pi*r*r; }
+inline float triangle_area(const vec3f& v0, const vec3f& v1, const vec3f& v2) { return length(cross(v1-v0,v2-v0))/2; }
 ///@}
 
 ///@name volume
@@ -60,6 +61,12 @@ bool intersect_point_approximate(const ray3f& ray, const vec3f& p, float r, floa
 bool intersect_line_approximate(const ray3f& ray, const vec3f& v0, const vec3f& v1, float r0, float r1, float& t, float& s);
 ///@}
 
+///@name closest point
+///@{
+/// closest point to p on the triangle v0,v1,v2
+vec3f closest_point_triangle(const vec3f& p, const vec3f& v0, const vec3f& v1, const vec3f& v2);
+///@}
+
 ///@name intersection - check only
 ///@{
 inline bool intersect_bbox(const ray3f& ray, const range3f& bbox) { float t0, t1; return intersect_bbox(ray,bbox,t0,t1); }
@@ -71,6 +78,45 @@ inline bool intersect_point_approximate(const ray3f& ray, const vec3f& p, float
 inline bool intersect_line_approximate(const ray3f& ray, const vec3f& v0, const vec3f& v1, float r0, float r1) { float t, s; return intersect_line_approximate(ray, v0, v1, r0, r1, t, s); }
 ///@}
 
+///@name intersection - several elements at once, in structure-of-arrays layout (SIMD when supported)
+///@{
+/// up to 8 triangles in structure-of-arrays layout
+struct triangles8f {
+    float v0[3][8]; ///< first vertices (by coordinate, then by lane)
+    float v1[3][8]; ///< second vertices (by coordinate, then by lane)
+    float v2[3][8]; ///< third vertices (by coordinate, then by lane)
+};
+/// up to 8 bounding boxes in structure-of-arrays layout
+struct bboxes8f {
+    float min[3][8]; ///< box min (by coordinate, then by lane)
+    float max[3][8]; ///< box max (by coordinate, then by lane)
+};
+/// intersect the first n triangles, returning the bitmask of the hit lanes and their t and baricentric coordinates
+int intersect_triangles8(const ray3f& ray, const triangles8f& triangles, int n, float* t, float* ba, float* bb);
+/// intersect the first n boxes with precomputed ray inverse direction, returning the bitmask of the hit lanes and their entry t
+int intersect_bboxes8(const ray3f& ray, const vec3f& ray_dinv, const bboxes8f& bboxes, int n, float* t0);
+/// number of lanes processed at once by the kernels above on this machine (1 for the scalar fallback, also used
+/// if the wider kernels disagree with it in the check run on first use)
+int intersect_simd_width();
+///@}
+
+///@name intersection - check only, with precomputed ray inverse direction (for traversal)
+///@{
+inline bool intersect_bbox(const ray3f& ray, const vec3f& ray_dinv, const range3f& bbox) {
+    auto t0 = ray.tmin, t1 = ray.tmax;
+    for(int i = 0; i < 3; i ++) {
+        auto tnear = (bbox.min[i] - ray.e[i]) * ray_dinv[i];
+        auto tfar  = (bbox.max[i] - ray.e[i]) * ray_dinv[i];
+        if(tnear > tfar) std::swap(tnear, tfar);
+        tfar *= 1.0000004f; // conservative far value to not miss hits on box faces
+        t0 = tnear > t0 ? tnear : t0;
+        t1 = tfar  < t1 ? tfar  : t1;
+        if(t0 > t1) return false;
+    }
+    return true;
+}
+///@}
+
 ///@}
 
 #endif
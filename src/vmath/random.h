@@ -6,6 +6,7 @@
 
 #include <random>
 #include <vector>
+#include <cstdint>
 
 ///@file vmath/random.h Random number generation. @ingroup vmath
 ///@defgroup random Random number generation
@@ -54,6 +55,56 @@ inline std::vector<Rng> rng_generate_seeded(int nrngs) {
     return rngs;
 }
 
+/// Philox2x32-10 block function: 64 random bits for the counter (c0,c1) and key
+/// (see: Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3", SC 2011)
+inline uint64_t rng_philox(uint32_t key, uint32_t c0, uint32_t c1) {
+    for(int round = 0; round < 10; round ++) {
+        auto p = uint64_t(c0) * 0xD256D193u;
+        c0 = uint32_t(p >> 32) ^ key ^ c1;
+        c1 = uint32_t(p);
+        key += 0x9E3779B9u;
+    }
+    return (uint64_t(c0) << 32) | c1;
+}
+
+/// Counter-based random number generator: the i-th number of a stream only depends on the key, the stream id and i,
+/// so that streams can be created on the fly for each item of a parallel loop (ex: one per particle id) and give
+/// the same numbers regardless of the order in which items are processed
+struct RngCounter {
+    uint32_t                                key = 0; ///< key (ex: the generator seed)
+    uint32_t                                stream = 0; ///< stream id (ex: the particle id)
+    uint32_t                                counter = 0; ///< numbers generated so far
+    
+    /// Default stream
+    RngCounter() { }
+    /// Stream with the given key and id
+    RngCounter(uint32_t key, uint32_t stream) : key(key), stream(stream) { }
+    
+    /// Generate 32 random bits
+    uint32_t next_uint() { return uint32_t(rng_philox(key, counter++, stream)); }
+    
+    /// Generate a float in [0,1)
+    float next_float() { return (next_uint() >> 8) * (1.0f / 16777216.0f); }
+    /// Generate a float in [a,b)
+    float next_float(float a, float b) { return a + (b-a) * next_float(); }
+    /// Generate a float in [v.x,v.y)
+    float next_float(const vec2f& v) { return next_float(v.x,v.y); }
+    /// Generate a float in [r.min,r.max)
+    float next_float(const range1f& r) { return next_float(r.min,r.max); }
+    
+    /// Generate 2 floats in [0,1)^2
+    vec2f next_vec2f() { auto x = next_float(); return vec2f(x,next_float()); }
+    /// Generate 3 floats in [0,1)^3
+    vec3f next_vec3f() { auto x = next_float(); auto y = next_float(); return vec3f(x,y,next_float()); }
+    
+    /// Generator an int in [a,b] (like Rng, b is included)
+    int next_int(int a, int b) { return a + int((uint64_t(next_uint()) * uint64_t(int64_t(b) - a + 1)) >> 32); }
+    /// Generator an int in [v.x,v.y]
+    int next_int(const vec2i& v) { return next_int(v.x,v.y); }
+    /// Generator an int in [r.min,r.max]
+    int next_int(const range1i& r) { return next_int(r.min,r.max); }
+};
+
 ///@}
 
 #endif
@@ -162,6 +162,7 @@ template<typename T> inline vec3<T> center(const range3<T>& a) { return (a.max+a
 
 template<typename T> inline range3<T> runion(const range3<T>& a, const vec3<T>& b) { if(not isvalid(a)) return range3<T>(b,b); return range3<T>(min(a.min,b),max(a.max,b)); }
 template<typename T> inline range3<T> runion(const range3<T>& a, const range3<T>& b) { if(not isvalid(a)) return b; if(not isvalid(b)) return a; return range3<T>(min(a.min,b.min),max(a.max,b.max)); }
+template<typename T> inline bool overlap(const range3<T>& a, const range3<T>& b) { return a.min.x <= b.max.x and b.min.x <= a.max.x and a.min.y <= b.max.y and b.min.y <= a.max.y and a.min.z <= b.max.z and b.min.z <= a.max.z; }
 
 template<typename T> inline range3<T> rscale(const range3<T>& a, const T& b) { return range3<T>(center(a)-size(a)*b/2,center(a)+size(a)*b/2); }
 